@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace media {
+
+    // Audio clock published by the audio callback and read by the video thread, without locks
+    // or allocation on the audio side. A sequence counter (seqlock) lets the reader detect and
+    // retry a sample that was being rewritten. There must be a single writer at a time.
+    class AudioClock {
+    public:
+        // pts (seconds) is what is being heard at stamp (steady clock microseconds), with the
+        // device queue latency already taken off. item and serial identify the buffer and the
+        // seek generation the samples came from.
+        struct Sample {
+            double pts;
+            double duration;
+            double speed;
+            int64_t stamp;
+            uint64_t item;
+            int64_t serial;
+        };
+
+        AudioClock()
+            : seq_(0)
+            , pts_(0.0)
+            , duration_(0.0)
+            , speed_(1.0)
+            , stamp_(0)
+            , item_(0)
+            , serial_(0) {
+        }
+
+        void publish(const Sample& sample) {
+            const uint32_t seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            pts_.store(sample.pts, std::memory_order_relaxed);
+            duration_.store(sample.duration, std::memory_order_relaxed);
+            speed_.store(sample.speed, std::memory_order_relaxed);
+            stamp_.store(sample.stamp, std::memory_order_relaxed);
+            item_.store(sample.item, std::memory_order_relaxed);
+            serial_.store(sample.serial, std::memory_order_relaxed);
+
+            seq_.store(seq + 2, std::memory_order_release);
+        }
+
+        // False until the first publish() after a reset().
+        bool read(Sample& sample) const {
+            while (true) {
+                const uint32_t begin = seq_.load(std::memory_order_acquire);
+                if (begin & 1) {
+                    continue;
+                }
+
+                sample.pts = pts_.load(std::memory_order_relaxed);
+                sample.duration = duration_.load(std::memory_order_relaxed);
+                sample.speed = speed_.load(std::memory_order_relaxed);
+                sample.stamp = stamp_.load(std::memory_order_relaxed);
+                sample.item = item_.load(std::memory_order_relaxed);
+                sample.serial = serial_.load(std::memory_order_relaxed);
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (seq_.load(std::memory_order_relaxed) == begin) {
+                    return sample.stamp > 0;
+                }
+            }
+        }
+
+        void reset() {
+            publish({ 0.0, 0.0, 1.0, 0, 0, 0 });
+        }
+
+        static int64_t now() {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+    private:
+        std::atomic<uint32_t> seq_;
+        std::atomic<double> pts_;
+        std::atomic<double> duration_;
+        std::atomic<double> speed_;
+        std::atomic<int64_t> stamp_;
+        std::atomic<uint64_t> item_;
+        std::atomic<int64_t> serial_;
+    };
+
+} // namespace media
\ No newline at end of file
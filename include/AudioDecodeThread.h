@@ -2,46 +2,63 @@
 
 #include <atomic>
 #include <memory>
+#include <QMutex>
 #include <QString>
 #include <QThread>
+#include <QWaitCondition>
 #include "MediaBuffer.h"
 #include "MediaContext.h"
+#include "MediaFramePool.h"
 
 class AudioDecodeThread : public QThread {
     Q_OBJECT
 
 public:
-    explicit AudioDecodeThread(QObject* parent = nullptr, std::shared_ptr<MediaBuffer> buffer = nullptr);
+    explicit AudioDecodeThread(QObject* parent = nullptr);
     ~AudioDecodeThread();
 
     void start();
     void stop();
-
-public slots:
-    void onFlushRequest();
+    bool bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    void unbind();
+    QString bindError() const;
 
 signals:
     void audioDecodeError(const QString& error);
+    void seekReached(qint64 elapsed);
 
 protected:
     void run() override;
 
 private:
     void processFrame();
+    bool trimToSeekTarget(AVFrame* frame) const;
     void flushDecoder();
+    void processEndOfStream();
+    void park();
     void cleanup();
 
 private:
+    std::shared_ptr<MediaContext> context_;
     std::shared_ptr<MediaBuffer> buffer_;
     AVCodecContext* decCtx_;
     SwrContext* swrCtx_;
     AVFrame* decFrm_;
     AVFrame* pcmFrm_;
+    media::MediaFramePool framePool_;
+
+    QMutex bindMutex_;
+    QWaitCondition bindWc_;
 
     QString initError_;
+    QString bindError_;
+    int samplerate_;
+    int64_t serial_;
+    int64_t seekTarget_;
+    bool parked_;
 
     std::atomic<bool> inited_;
-    std::atomic<bool> flush_;
+    std::atomic<bool> bound_;
     std::atomic<bool> running_;
     std::atomic<bool> started_;
 };
\ No newline at end of file
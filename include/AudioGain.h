@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MEDIA_GAIN_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+namespace media {
+
+    enum class GainKernel {
+        Reference,
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    struct GainBenchmark {
+        GainKernel kernel;
+        double samplesPerSecond;
+    };
+
+    // Volume stage for interleaved S16 samples. The gain moves linearly from `from` to `to`
+    // over the buffer so a volume change does not step in the middle of a waveform, results
+    // saturate at the int16 range. apply() picks the widest kernel the CPU supports once.
+    class AudioGain {
+    public:
+        static void apply(int16_t* samples, size_t count, float from, float to);
+        static void apply(GainKernel kernel, int16_t* samples, size_t count, float from, float to);
+
+        static GainKernel bestKernel();
+        static bool supported(GainKernel kernel);
+        static const char* name(GainKernel kernel);
+
+        // Samples per second of every supported kernel at a constant gain. Reference is the
+        // per-sample clamp loop the player used before.
+        static std::vector<GainBenchmark> benchmark(size_t count = 4096, int iterations = 2000);
+
+    private:
+        static void applyReference(int16_t* samples, size_t count, float gain);
+        static void applyScalar(int16_t* samples, size_t count, float from, float step);
+#if defined(MEDIA_GAIN_X86)
+        static void applySSE2(int16_t* samples, size_t count, float from, float step);
+        static void applyAVX2(int16_t* samples, size_t count, float from, float step);
+        static bool cpuHasAVX2();
+#endif
+
+        static constexpr float SAMPLE_MIN = -32768.0f;
+        static constexpr float SAMPLE_MAX = 32767.0f;
+    };
+
+} // namespace media
\ No newline at end of file
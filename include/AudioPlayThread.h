@@ -1,11 +1,17 @@
 #pragma once
 
 #include <atomic>
+#include <mutex>
 #include <memory>
+#include <algorithm>
 #include <QMutex>
 #include <QString>
 #include <QThread>
+#include <QWaitCondition>
 #include "SDL3.h"
+#include "PcmRing.h"
+#include "AudioGain.h"
+#include "AudioClock.h"
 #include "TempoFilter.h"
 #include "MediaBuffer.h"
 #include "MediaContext.h"
@@ -14,51 +20,93 @@ class AudioPlayThread : public QThread {
     Q_OBJECT
 
 public:
-    explicit AudioPlayThread(QObject* parent = nullptr, std::shared_ptr<MediaBuffer> buffer = nullptr);
+    explicit AudioPlayThread(QObject* parent = nullptr, int samplerate = 0);
     ~AudioPlayThread();
 
     void start();
     void stop();
+    bool bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    void unbind();
+    QString bindError() const;
+    int sampleRate() const;
     void pause();
     void resume();
     void setSpeed(float speed);
     void setVolume(int volume);
     double getCurrentTime() const;
-
-public slots:
-    void onFlushStream();
+    void setNextSource(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    // Callbacks since bind() that found the ring short of the requested bytes while playing.
+    quint64 underruns() const;
+    // Set before start(). The render thread publishes its clock here instead of signalling.
+    void setAudioClock(std::shared_ptr<media::AudioClock> clock);
 
 signals:
     void audioPlayError(const QString& error);
-    void updateAudioClock(double pts, double duration);
+    // Once per bind, when the first samples of the media are handed to the device.
+    void firstFrame();
+    void sourceSwitched();
 
 protected:
     void run() override;
 
 private:
-    int processFrame(uint8_t* buffer, int size);
+    bool processFrame();
+    void flushRing();
+    AVFrame* nextFrame();
+    bool switchSource();
     int processVolume(uint8_t* buffer, int size);
+    void publishClock(double pts, double duration);
+    void holdClock(bool paused);
+    void wakeRender();
     static void SDLCALL audioStreamCallback(void* userdata, SDL_AudioStream* stream, int additional, int total);
     void cleanup();
 
 private:
+    // The render thread keeps TARGET_LATENCY_MS of samples in the ring and checks it again
+    // every FILL_INTERVAL_MS.
+    static constexpr int TARGET_LATENCY_MS = 60;
+    static constexpr int FILL_INTERVAL_MS = 5;
+
+    std::shared_ptr<MediaContext> context_;
     std::shared_ptr<MediaBuffer> buffer_;
+    std::shared_ptr<MediaContext> nextContext_;
+    std::shared_ptr<MediaBuffer> nextBuffer_;
     std::unique_ptr<media::TempoFilter> filter_;
+    std::shared_ptr<media::AudioClock> clock_;
+    media::PcmRing ring_;
+    std::mutex ringMutex_;
 
     SDL_AudioStream* SDLAudioStream_;
     uint8_t* SDLAudioBuffer_;
     size_t SDLAudioBufferSize_;
+    uint8_t* renderBuffer_;
+    AVFrame* renderFrame_;
+    size_t targetBytes_;
+    int bytesPerSecond_;
+    int frameBytes_;
 
     QMutex mutex_;
+    QMutex bindMutex_;
+    QMutex stopMutex_;
+    QWaitCondition stopWc_;
     QString initError_;
+    QString bindError_;
+    int samplerate_;
 
     float speed_;
-    float volume_;
+    float gain_;
+    int64_t serial_;
 
+    std::atomic<bool> ended_;
     std::atomic<bool> inited_;
-    std::atomic<bool> flush_;
+    std::atomic<bool> bound_;
     std::atomic<bool> paused_;
     std::atomic<bool> running_;
     std::atomic<bool> started_;
+    std::atomic<bool> firstFrame_;
+    std::atomic<bool> clockPending_;
+    std::atomic<float> volume_;
+    std::atomic<quint64> item_;
+    std::atomic<quint64> underruns_;
     std::atomic<double> currentTime_;
 };
\ No newline at end of file
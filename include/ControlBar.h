@@ -16,6 +16,8 @@ class ControlBar : public QFrame {
     Q_OBJECT
 
 public:
+    static constexpr int PROGRESS_MAX = 10000;
+
     explicit ControlBar(QWidget* parent = nullptr);
     ~ControlBar() = default;
 
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include "FFmpeg.h"
+
+namespace media {
+
+    enum class DecodeThreadMode {
+        Auto,
+        Frame,
+        Slice,
+        Fixed,
+    };
+
+    // threads is the exact count for Fixed and an upper bound for the other modes, 0 meaning
+    // the number of cores.
+    struct DecodeThreadPolicy {
+        DecodeThreadMode mode = DecodeThreadMode::Auto;
+        int threads = 0;
+    };
+
+    struct DecodeThreadSetup {
+        int count;
+        int type;
+    };
+
+    struct CodecContextDeleter {
+        void operator()(AVCodecContext* ctx) const;
+    };
+
+    using CodecContextPtr = std::unique_ptr<AVCodecContext, CodecContextDeleter>;
+
+    // Thread count and type of the video decoders. Auto starts from the resolution and the
+    // cores left over by the other open decoders, so many small previews share the machine
+    // instead of each taking every core. The decode threads report their measured decode
+    // rate and the result is remembered per codec and resolution for the next open.
+    class DecodeThreading {
+    public:
+        // "auto", "frame", "slice", optionally followed by ":<max threads>", or a fixed count.
+        static bool parse(const std::string& text, DecodeThreadPolicy& policy);
+
+        static DecodeThreadSetup choose(const DecodeThreadPolicy& policy, const AVCodec* codec, int width, int height);
+        static void apply(AVCodecContext* ctx, const DecodeThreadSetup& setup);
+
+        // Returns the thread count the decoder should be reopened with, or 0 to keep it.
+        static int tune(const DecodeThreadPolicy& policy, const AVCodecContext* ctx, double decodeFps, double neededFps);
+
+        static void decoderOpened();
+        static void decoderClosed();
+        static int activeDecoders();
+
+    private:
+        struct Tuning {
+            int threads;
+            int floor;
+        };
+
+        static int maxThreads(const DecodeThreadPolicy& policy);
+        static uint64_t tuningKey(int codecId, int width, int height);
+
+        // Decoding below HEADROOM times the needed rate counts as falling behind, above
+        // SURPLUS times it the next open tries half the threads.
+        static constexpr double HEADROOM = 1.2;
+        static constexpr double SURPLUS = 4.0;
+
+        static std::mutex mutex_;
+        static std::map<uint64_t, Tuning> tunings_;
+        static std::atomic<int> active_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -8,32 +8,48 @@
 #include <QWaitCondition>
 #include "MediaBuffer.h"
 #include "MediaContext.h"
+#include "KeyframeIndex.h"
 
 class DemuxThread : public QThread {
     Q_OBJECT
 
 public:
-    explicit DemuxThread(QObject* parent = nullptr, std::shared_ptr<MediaBuffer> buffer = nullptr);
+    explicit DemuxThread(QObject* parent = nullptr);
     ~DemuxThread();
 
     void start();
     void stop();
-    void seek(int64_t seconds);
+    bool bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    void unbind();
+    QString bindError() const;
+    // timestamp is in AV_TIME_BASE units from the start of the media (0 to the duration);
+    // the container's start_time is added before seeking.
+    qint64 seek(int64_t timestamp);
+    void setAccurateSeek(bool accurate);
+    void setKeyframeIndex(std::shared_ptr<const media::KeyframeIndex> index);
 
 signals:
     void demuxError(const QString& error);
-    void flushRequest();
+    void seekFinished(qint64 request);
 
 protected:
     void run() override;
 
 private:
     void processPacket();
+    void processEndOfStream();
+    void enqueuePacket(AVPacket* packet, bool video);
     void performSeek();
+    int64_t streamTimestamp(int64_t timestamp) const;
+    int seekFile(int64_t timestamp, const media::KeyframeIndex* index);
+    void park();
     void cleanup();
+    static int interruptCallback(void* opaque);
 
 private:
+    std::shared_ptr<MediaContext> context_;
     std::shared_ptr<MediaBuffer> buffer_;
+    std::shared_ptr<const media::KeyframeIndex> index_;
     AVFormatContext* inputCtx_;
     AVPacket* pkt_;
     int vsIndex_;
@@ -41,14 +57,23 @@ private:
 
     QMutex mutex_;
     QMutex eofMutex_;
+    QMutex bindMutex_;
     QWaitCondition eofWc_;
+    QWaitCondition bindWc_;
 
     QString initError_;
-    int64_t seekSeconds_;
+    QString bindError_;
+    int64_t seekTarget_;
+    qint64 seekRequest_;
+    int64_t serial_;
+    bool parked_;
 
     std::atomic<bool> inited_;
+    std::atomic<bool> bound_;
+    std::atomic<bool> interruptible_;
     std::atomic<bool> eof_;
     std::atomic<bool> seeking_;
+    std::atomic<bool> accurateSeek_;
     std::atomic<bool> running_;
     std::atomic<bool> started_;
 };
\ No newline at end of file
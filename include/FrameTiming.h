@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+
+namespace media {
+
+    // Presentation error of video frames: how far behind its deadline each frame reached the
+    // renderer, in microseconds. Early frames count in the first bin. Written by the play
+    // thread, readable from any thread.
+    class FrameTimingHistogram {
+    public:
+        static constexpr int BINS = 8;
+        static constexpr int64_t BOUNDS[BINS - 1] = { 100, 250, 500, 1000, 2000, 4000, 8000 };
+
+        FrameTimingHistogram() {
+            reset();
+        }
+
+        void add(int64_t error) {
+            int bin = 0;
+            while (bin < BINS - 1 && error >= BOUNDS[bin]) {
+                ++bin;
+            }
+            bins_[bin].fetch_add(1, std::memory_order_relaxed);
+
+            int64_t max = max_.load(std::memory_order_relaxed);
+            while (error > max && !max_.compare_exchange_weak(max, error, std::memory_order_relaxed)) {
+            }
+        }
+
+        void reset() {
+            for (auto& bin : bins_) {
+                bin.store(0, std::memory_order_relaxed);
+            }
+            max_.store(0, std::memory_order_relaxed);
+        }
+
+        uint64_t count(int bin) const {
+            return bins_[bin].load(std::memory_order_relaxed);
+        }
+
+        uint64_t total() const {
+            uint64_t sum = 0;
+            for (int i = 0; i < BINS; ++i) {
+                sum += count(i);
+            }
+            return sum;
+        }
+
+        int64_t max() const {
+            return max_.load(std::memory_order_relaxed);
+        }
+
+        // "<0.1ms 590, <0.25ms 12, ... >=8ms 0, max 3.2ms"
+        std::string toString() const {
+            std::string text;
+            char item[48];
+            for (int i = 0; i < BINS; ++i) {
+                if (i < BINS - 1) {
+                    std::snprintf(item, sizeof(item), "<%gms %llu, ", BOUNDS[i] / 1000.0,
+                                  static_cast<unsigned long long>(count(i)));
+                }
+                else {
+                    std::snprintf(item, sizeof(item), ">=%gms %llu, ", BOUNDS[i - 1] / 1000.0,
+                                  static_cast<unsigned long long>(count(i)));
+                }
+                text += item;
+            }
+            std::snprintf(item, sizeof(item), "max %.2fms", max() / 1000.0);
+            text += item;
+            return text;
+        }
+
+    private:
+        std::array<std::atomic<uint64_t>, BINS> bins_;
+        std::atomic<int64_t> max_;
+    };
+
+} // namespace media
\ No newline at end of file
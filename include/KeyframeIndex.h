@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <QDir>
+#include <QFile>
+#include <QString>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include "FFmpeg.h"
+
+namespace media {
+
+    // pts is in AV_TIME_BASE units on the stream timeline, unwrapped across timestamp
+    // discontinuities: the keyframes after a jump or a 33-bit wrap continue from the ones
+    // before it. Entries are in file order, pos is the byte offset of the keyframe packet.
+    struct KeyframeEntry {
+        int64_t pts;
+        int64_t pos;
+    };
+
+    // Keyframe table of one stream, stored as a sidecar file in the cache directory and
+    // memory mapped on open. The sidecar is keyed by the media file's size and mtime, so a
+    // modified file is simply indexed again.
+    class KeyframeIndex {
+    public:
+        KeyframeIndex(const KeyframeIndex&) = delete;
+        KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+        KeyframeIndex(KeyframeIndex&&) = delete;
+        KeyframeIndex& operator=(KeyframeIndex&&) = delete;
+
+        KeyframeIndex();
+        ~KeyframeIndex();
+
+        static QString cachePath(const QString& filePath);
+
+        int open(const QString& filePath, int streamIndex);
+        int build(const QString& filePath, int streamIndex, const std::atomic<bool>& abort);
+        void close();
+
+        bool lookup(int64_t timestamp, KeyframeEntry* entry) const;
+        size_t size() const { return count_; }
+        bool valid() const { return entries_ != nullptr; }
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            int64_t fileSize;
+            int64_t mtime;
+            int32_t streamIndex;
+            uint32_t count;
+        };
+
+        static constexpr uint32_t VERSION = 2;
+        // A forward jump larger than MAX_KEYFRAME_GAP (AV_TIME_BASE units) between two
+        // keyframes counts as a discontinuity, like any backward jump.
+        static constexpr int64_t MAX_KEYFRAME_GAP = 30 * AV_TIME_BASE;
+
+        static int interruptCallback(void* opaque);
+
+    private:
+        std::unique_ptr<QFile> file_;
+        const KeyframeEntry* entries_;
+        size_t count_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <QString>
+#include <QThread>
+#include "KeyframeIndex.h"
+
+class KeyframeIndexThread : public QThread {
+    Q_OBJECT
+
+public:
+    explicit KeyframeIndexThread(QObject* parent = nullptr, const QString& filePath = QString(), int streamIndex = -1);
+    ~KeyframeIndexThread();
+
+    void start();
+    void stop();
+    std::shared_ptr<const media::KeyframeIndex> index() const;
+
+signals:
+    void indexReady();
+
+protected:
+    void run() override;
+
+private:
+    std::shared_ptr<media::KeyframeIndex> index_;
+    QString filePath_;
+    int streamIndex_;
+
+    std::atomic<bool> ready_;
+    std::atomic<bool> abort_;
+    std::atomic<bool> started_;
+};
\ No newline at end of file
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include "FFmpeg.h"
+
+namespace media {
+
+    // Memory and play time held by one queued item. Durations are in AV_TIME_BASE units.
+    template<typename T>
+    struct MediaItemTraits {
+        static size_t bytes(const T*) { return 0; }
+        static int64_t duration(const T*) { return 0; }
+    };
+
+    template<>
+    struct MediaItemTraits<AVPacket> {
+        static size_t bytes(const AVPacket* p) {
+            return sizeof(AVPacket) + (p->buf ? p->buf->size : static_cast<size_t>(p->size > 0 ? p->size : 0));
+        }
+
+        static int64_t duration(const AVPacket* p) {
+            if (p->duration <= 0 || p->time_base.num <= 0 || p->time_base.den <= 0) {
+                return 0;
+            }
+            return av_rescale_q(p->duration, p->time_base, AV_TIME_BASE_Q);
+        }
+    };
+
+    template<>
+    struct MediaItemTraits<AVFrame> {
+        static size_t bytes(const AVFrame* f) {
+            size_t total = sizeof(AVFrame);
+            for (int i = 0; i < AV_NUM_DATA_POINTERS && f->buf[i]; ++i) {
+                total += f->buf[i]->size;
+            }
+            for (int i = 0; i < f->nb_extended_buf; ++i) {
+                total += f->extended_buf[i]->size;
+            }
+            return total;
+        }
+
+        static int64_t duration(const AVFrame* f) {
+            if (f->duration > 0 && f->time_base.num > 0 && f->time_base.den > 0) {
+                return av_rescale_q(f->duration, f->time_base, AV_TIME_BASE_Q);
+            }
+            if (f->nb_samples > 0 && f->sample_rate > 0) {
+                return av_rescale(f->nb_samples, AV_TIME_BASE, f->sample_rate);
+            }
+            return 0;
+        }
+    };
+
+    // Bytes held by every MediaBuffer queue in the process. Once used() reaches cap(),
+    // non-empty queues stop accepting items until the consumers catch up. Producers held
+    // back by the cap sleep in wait() and are woken by notify(), which the queues call
+    // after handing bytes back, so memory freed by any queue lets them continue.
+    class MediaMemoryBudget {
+    public:
+        static constexpr size_t DEFAULT_CAP = 512ULL * 1024 * 1024;
+
+        static void setCap(size_t bytes) {
+            cap_.store(bytes);
+            notify();
+        }
+
+        static size_t cap() { return cap_.load(std::memory_order_relaxed); }
+        static size_t used() { return used_.load(std::memory_order_relaxed); }
+
+        static bool exceeded() {
+            const size_t limit = cap();
+            return limit > 0 && used() >= limit;
+        }
+
+        static void add(size_t bytes) { used_.fetch_add(bytes, std::memory_order_relaxed); }
+        static void sub(size_t bytes) { used_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+        // Only takes the mutex when a producer is actually asleep.
+        static void notify() {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting_.load() > 0) {
+                std::lock_guard<std::mutex> locker(mutex_);
+                cv_.notify_all();
+            }
+        }
+
+        // Sleeps while the cap is exceeded and stop() is false. A null deadline waits without
+        // a timeout; false means the deadline passed.
+        template<typename Predicate>
+        static bool wait(const std::chrono::steady_clock::time_point* deadline, Predicate stop) {
+            waiting_.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool ok = true;
+            {
+                std::unique_lock<std::mutex> locker(mutex_);
+                while (exceeded() && !stop()) {
+                    if (!deadline) {
+                        cv_.wait(locker);
+                    }
+                    else if (cv_.wait_until(locker, *deadline) == std::cv_status::timeout) {
+                        ok = false;
+                        break;
+                    }
+                }
+            }
+            waiting_.fetch_sub(1);
+
+            return ok;
+        }
+
+    private:
+        static inline std::atomic<size_t> cap_{ DEFAULT_CAP };
+        static inline std::atomic<size_t> used_{ 0 };
+        static inline std::atomic<int> waiting_{ 0 };
+        static inline std::mutex mutex_;
+        static inline std::condition_variable cv_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -1,10 +1,17 @@
 #pragma once
 
-#include <vector>
-#include <type_traits>
-#include <unordered_map>
+#include <array>
+#include <tuple>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include "FFmpeg.h"
 #include "MediaQueue.h"
+#include "MediaBudget.h"
+#include "MediaRingQueue.h"
+#include "MediaWaitQueue.h"
+#include "MediaPacketPool.h"
 
 namespace media {
 
@@ -19,22 +26,80 @@ namespace media {
         ENCODING,
     };
 
+    // maxBytes and maxDuration (seconds) of 0 leave that limit disabled. A queue is full as
+    // soon as any of its limits, or the process-wide MediaMemoryBudget cap, is reached.
     struct MediaLimit {
         MediaType type;
         MediaState state;
         size_t minSize;
         size_t maxSize;
+        size_t maxBytes;
+        double maxDuration;
     };
 
     static const MediaLimit MediaLimit_Preset[] = {
-        {VIDEO, DEMUXING, 30ULL,  60ULL},
-        {AUDIO, DEMUXING, 50ULL,  100ULL},
-        {VIDEO, DECODING, 30ULL,  60ULL},
-        {AUDIO, DECODING, 500ULL, 1000ULL},
-        {VIDEO, ENCODING, 30ULL,  60ULL},
-        {AUDIO, ENCODING, 500ULL, 1000ULL},
+        {VIDEO, DEMUXING, 30ULL,  60ULL,   32ULL << 20,  0.0},
+        {AUDIO, DEMUXING, 50ULL,  100ULL,  4ULL << 20,   0.0},
+        {VIDEO, DECODING, 30ULL,  60ULL,   192ULL << 20, 0.0},
+        {AUDIO, DECODING, 500ULL, 1000ULL, 16ULL << 20,  0.0},
+        {VIDEO, ENCODING, 30ULL,  60ULL,   32ULL << 20,  0.0},
+        {AUDIO, ENCODING, 500ULL, 1000ULL, 4ULL << 20,   0.0},
     };
 
+    // Blocking stages wait without a timeout; unbind, stop, seeks and source switches cancel
+    // the wait through wakeup().
+    static constexpr int MediaWait_Infinite = -1;
+
+    // Every stage has exactly one producer and one consumer, so the lock-free ring is the
+    // default. Define MEDIA_BUFFER_LOCKED_QUEUE to fall back to the mutex based queue.
+#ifdef MEDIA_BUFFER_LOCKED_QUEUE
+    template<typename T>
+    using BufferQueue = MediaWaitQueue<MediaQueue<T>, T>;
+#else
+    template<typename T>
+    using BufferQueue = MediaWaitQueue<MediaRingQueue<T>, T>;
+#endif
+
+    // Item type carried by each stage: packets before the decoder, frames after it.
+    template<MediaState Ts>
+    struct MediaStage {
+        using Item = AVPacket;
+    };
+
+    template<>
+    struct MediaStage<DECODING> {
+        using Item = AVFrame;
+    };
+
+    template<MediaState Ts>
+    using MediaItem = typename MediaStage<Ts>::Item;
+
+    // Seek generation of a packet or frame, carried in its opaque field. Every seek starts a
+    // new generation and each stage drops items from older ones.
+    template<typename T>
+    inline void setItemSerial(T* item, int64_t serial) {
+        item->opaque = reinterpret_cast<void*>(static_cast<intptr_t>(serial));
+    }
+
+    template<typename T>
+    inline int64_t itemSerial(const T* item) {
+        return static_cast<int64_t>(reinterpret_cast<intptr_t>(item->opaque));
+    }
+
+    // End of stream marker queued behind the last item of a generation: a packet without a
+    // stream or a frame without format and buffers. Stages that see it drain and forward it.
+    inline void setEndOfStream(AVPacket* packet) {
+        packet->stream_index = -1;
+    }
+
+    inline bool isEndOfStream(const AVPacket* packet) {
+        return packet->stream_index < 0;
+    }
+
+    inline bool isEndOfStream(const AVFrame* frame) {
+        return frame->format < 0 && !frame->buf[0];
+    }
+
 } // namespace media
 
 class MediaBuffer {
@@ -44,51 +109,17 @@ public:
     MediaBuffer(MediaBuffer&&) = delete;
     MediaBuffer& operator=(MediaBuffer&&) = delete;
 
-    MediaBuffer() {
-        auto createQueue = [this](media::MediaType t, media::MediaState s, size_t l, size_t r) {
-            switch (s) {
-            case media::DEMUXING:
-            case media::ENCODING: {
-                media::MediaQueue<AVPacket> q(l, r);
-                q.setClearCallback([](AVPacket* p) {
-                    if (p) {
-                        av_packet_free(&p);
-                    }
-                    });
-                switch (t) {
-                case media::VIDEO:
-                    videoPackets_[s].push_back(std::move(q));
-                    break;
-                case media::AUDIO:
-                    audioPackets_[s].push_back(std::move(q));
-                    break;
-                }
-                break;
-            }
-            case media::DECODING: {
-                media::MediaQueue<AVFrame> q(l, r);
-                q.setClearCallback([](AVFrame* f) {
-                    if (f) {
-                        av_frame_free(&f);
-                    }
-                    });
-                switch (t) {
-                case media::VIDEO:
-                    videoFrames_[s].push_back(std::move(q));
-                    break;
-                case media::AUDIO:
-                    audioFrames_[s].push_back(std::move(q));
-                    break;
-                }
-                break;
-            }
-            }
-            };
-
-        createQueue(media::VIDEO, media::DEMUXING, media::MediaLimit_Preset[0].minSize, media::MediaLimit_Preset[0].maxSize);
-        createQueue(media::AUDIO, media::DEMUXING, media::MediaLimit_Preset[1].minSize, media::MediaLimit_Preset[1].maxSize);
-        createQueue(media::VIDEO, media::DECODING, media::MediaLimit_Preset[2].minSize, media::MediaLimit_Preset[2].maxSize);
-        createQueue(media::AUDIO, media::DECODING, media::MediaLimit_Preset[3].minSize, media::MediaLimit_Preset[3].maxSize);
+    MediaBuffer()
+        : id_(nextId())
+        , serial_(0)
+        , seekTarget_(AV_NOPTS_VALUE)
+        , seekStart_(0) {
+        setupQueue<media::VIDEO, media::DEMUXING>(media::MediaLimit_Preset[0]);
+        setupQueue<media::AUDIO, media::DEMUXING>(media::MediaLimit_Preset[1]);
+        setupQueue<media::VIDEO, media::DECODING>(media::MediaLimit_Preset[2]);
+        setupQueue<media::AUDIO, media::DECODING>(media::MediaLimit_Preset[3]);
+        setupQueue<media::VIDEO, media::ENCODING>(media::MediaLimit_Preset[4]);
+        setupQueue<media::AUDIO, media::ENCODING>(media::MediaLimit_Preset[5]);
     }
 
     ~MediaBuffer() {
@@ -96,375 +127,176 @@ public:
         clear();
     }
 
-    template<typename T, media::MediaType Tt, media::MediaState Ts>
-    bool enqueue(T* item, size_t index = 0) {
-        if (!item) {
-            return false;
-        }
-
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            if constexpr (std::is_same_v<T, AVPacket>) {
-                switch (Tt) {
-                case media::VIDEO: {
-                    auto it = videoPackets_.find(Ts);
-                    if (it != videoPackets_.end() && index < it->second.size()) {
-                        return it->second[index].enqueue(item);
-                    }
-                    break;
-                }
-                case media::AUDIO: {
-                    auto it = audioPackets_.find(Ts);
-                    if (it != audioPackets_.end() && index < it->second.size()) {
-                        return it->second[index].enqueue(item);
-                    }
-                    break;
-                }
-                }
-            }
-            break;
-        }
-        case media::DECODING: {
-            if constexpr (std::is_same_v<T, AVFrame>) {
-                switch (Tt) {
-                case media::VIDEO: {
-                    auto it = videoFrames_.find(Ts);
-                    if (it != videoFrames_.end() && index < it->second.size()) {
-                        return it->second[index].enqueue(item);
-                    }
-                    break;
-                }
-                case media::AUDIO: {
-                    auto it = audioFrames_.find(Ts);
-                    if (it != audioFrames_.end() && index < it->second.size()) {
-                        return it->second[index].enqueue(item);
-                    }
-                    break;
-                }
-                }
-            }
-            break;
-        }
-        }
+    template<media::MediaType Tt, media::MediaState Ts>
+    bool enqueue(media::MediaItem<Ts>* item, int timeout = 0) {
+        return queue<Tt, Ts>().enqueue(item, timeout);
+    }
 
-        return false;
+    template<media::MediaType Tt, media::MediaState Ts>
+    media::MediaItem<Ts>* dequeue(int timeout = 0) {
+        return queue<Tt, Ts>().dequeue(timeout);
     }
 
     template<media::MediaType Tt, media::MediaState Ts>
-    void* dequeue(size_t index = 0) {
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoPackets_.find(Ts);
-                if (it != videoPackets_.end() && index < it->second.size()) {
-                    return it->second[index].dequeue();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioPackets_.find(Ts);
-                if (it != audioPackets_.end() && index < it->second.size()) {
-                    return it->second[index].dequeue();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        case media::DECODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoFrames_.find(Ts);
-                if (it != videoFrames_.end() && index < it->second.size()) {
-                    return it->second[index].dequeue();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioFrames_.find(Ts);
-                if (it != audioFrames_.end() && index < it->second.size()) {
-                    return it->second[index].dequeue();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        }
+    size_t size() const {
+        return queue<Tt, Ts>().size();
+    }
 
-        return nullptr;
+    template<media::MediaType Tt, media::MediaState Ts>
+    size_t bytes() const {
+        return queue<Tt, Ts>().bytes();
     }
 
     template<media::MediaType Tt, media::MediaState Ts>
-    size_t size(size_t index = 0) const {
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoPackets_.find(Ts);
-                if (it != videoPackets_.end() && index < it->second.size()) {
-                    return it->second[index].size();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioPackets_.find(Ts);
-                if (it != audioPackets_.end() && index < it->second.size()) {
-                    return it->second[index].size();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        case media::DECODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoFrames_.find(Ts);
-                if (it != videoFrames_.end() && index < it->second.size()) {
-                    return it->second[index].size();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioFrames_.find(Ts);
-                if (it != audioFrames_.end() && index < it->second.size()) {
-                    return it->second[index].size();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        }
+    double duration() const {
+        return queue<Tt, Ts>().duration();
+    }
 
-        return 0;
+    template<media::MediaType Tt, media::MediaState Ts>
+    bool empty() const {
+        return queue<Tt, Ts>().empty();
     }
 
     template<media::MediaType Tt, media::MediaState Ts>
-    bool empty(size_t index = 0) const {
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoPackets_.find(Ts);
-                if (it != videoPackets_.end() && index < it->second.size()) {
-                    return it->second[index].empty();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioPackets_.find(Ts);
-                if (it != audioPackets_.end() && index < it->second.size()) {
-                    return it->second[index].empty();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        case media::DECODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoFrames_.find(Ts);
-                if (it != videoFrames_.end() && index < it->second.size()) {
-                    return it->second[index].empty();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioFrames_.find(Ts);
-                if (it != audioFrames_.end() && index < it->second.size()) {
-                    return it->second[index].empty();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        }
+    bool full() const {
+        return queue<Tt, Ts>().full();
+    }
 
-        return true;
+    template<media::MediaType Tt, media::MediaState Ts>
+    void setLimit(size_t l, size_t r) {
+        queue<Tt, Ts>().setLimit(l, r);
     }
 
     template<media::MediaType Tt, media::MediaState Ts>
-    bool full(size_t index = 0) const {
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoPackets_.find(Ts);
-                if (it != videoPackets_.end() && index < it->second.size()) {
-                    return it->second[index].full();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioPackets_.find(Ts);
-                if (it != audioPackets_.end() && index < it->second.size()) {
-                    return it->second[index].full();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        case media::DECODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoFrames_.find(Ts);
-                if (it != videoFrames_.end() && index < it->second.size()) {
-                    return it->second[index].full();
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioFrames_.find(Ts);
-                if (it != audioFrames_.end() && index < it->second.size()) {
-                    return it->second[index].full();
-                }
-                break;
-            }
-            }
-            break;
-        }
-        }
+    void setBudget(size_t maxBytes, double maxDuration) {
+        queue<Tt, Ts>().setBudget(maxBytes, maxDuration);
+    }
 
-        return false;
+    AVPacket* acquirePacket() {
+        return packetPool_.acquire();
     }
 
-    template<media::MediaType Tt, media::MediaState Ts>
-    void setLimit(size_t l, size_t r, size_t index = 0) {
-        switch (Ts) {
-        case media::DEMUXING:
-        case media::ENCODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoPackets_.find(Ts);
-                if (it != videoPackets_.end() && index < it->second.size()) {
-                    it->second[index].setLimit(l, r);
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioPackets_.find(Ts);
-                if (it != audioPackets_.end() && index < it->second.size()) {
-                    it->second[index].setLimit(l, r);
-                }
-                break;
-            }
-            }
-            break;
-        }
-        case media::DECODING: {
-            switch (Tt) {
-            case media::VIDEO: {
-                auto it = videoFrames_.find(Ts);
-                if (it != videoFrames_.end() && index < it->second.size()) {
-                    it->second[index].setLimit(l, r);
-                }
-                break;
-            }
-            case media::AUDIO: {
-                auto it = audioFrames_.find(Ts);
-                if (it != audioFrames_.end() && index < it->second.size()) {
-                    it->second[index].setLimit(l, r);
-                }
-                break;
-            }
-            }
-            break;
-        }
-        }
+    void releasePacket(AVPacket* p) {
+        packetPool_.release(p);
     }
 
-    void lock() {
-        for (auto& v : videoPackets_) {
-            for (auto& q : v.second) {
-                q.lock();
-            }
-        }
+    media::MediaPoolStats packetPoolStats() const {
+        return packetPool_.stats();
+    }
 
-        for (auto& v : audioPackets_) {
-            for (auto& q : v.second) {
-                q.lock();
-            }
-        }
+    // Unique per instance, tells apart the clocks of media played one after another.
+    uint64_t id() const {
+        return id_;
+    }
 
-        for (auto& v : videoFrames_) {
-            for (auto& q : v.second) {
-                q.lock();
-            }
-        }
+    int64_t serial() const {
+        return serial_.load(std::memory_order_acquire);
+    }
 
-        for (auto& v : audioFrames_) {
-            for (auto& q : v.second) {
-                q.lock();
-            }
-        }
+    // seekTarget (AV_TIME_BASE) asks the decoders to discard everything before it in the new
+    // serial; AV_NOPTS_VALUE plays from wherever the demuxer landed.
+    // Waits blocked on the previous serial are cancelled so they see the new one.
+    int64_t nextSerial(int64_t seekTarget = AV_NOPTS_VALUE) {
+        seekTarget_.store(seekTarget, std::memory_order_relaxed);
+        seekStart_.store(now(), std::memory_order_relaxed);
+        const int64_t serial = serial_.fetch_add(1, std::memory_order_acq_rel) + 1;
+        wakeup();
+        return serial;
     }
 
-    void unlock() {
-        for (auto& v : videoPackets_) {
-            for (auto& q : v.second) {
-                q.unlock();
-            }
-        }
+    int64_t seekTarget(int64_t serial) const {
+        const int64_t target = seekTarget_.load(std::memory_order_relaxed);
+        return serial == serial_.load(std::memory_order_acquire) ? target : AV_NOPTS_VALUE;
+    }
 
-        for (auto& v : audioPackets_) {
-            for (auto& q : v.second) {
-                q.unlock();
-            }
-        }
+    // Microseconds since the current serial was opened.
+    int64_t seekElapsed() const {
+        return now() - seekStart_.load(std::memory_order_relaxed);
+    }
 
-        for (auto& v : videoFrames_) {
-            for (auto& q : v.second) {
-                q.unlock();
-            }
-        }
+    static void setMemoryCap(size_t bytes) {
+        media::MediaMemoryBudget::setCap(bytes);
+    }
 
-        for (auto& v : audioFrames_) {
-            for (auto& q : v.second) {
-                q.unlock();
-            }
-        }
+    static size_t memoryUsed() {
+        return media::MediaMemoryBudget::used();
+    }
+
+    void lock() {
+        forEachQueue([](auto& q) { q.lock(); });
+    }
+
+    void unlock() {
+        forEachQueue([](auto& q) { q.unlock(); });
+    }
+
+    void wakeup() {
+        forEachQueue([](auto& q) { q.wakeup(); });
     }
 
     void clear() {
-        for (auto& v : videoPackets_) {
-            for (auto& q : v.second) {
-                q.clear();
-            }
-        }
+        forEachQueue([](auto& q) { q.clear(); });
+    }
 
-        for (auto& v : audioPackets_) {
-            for (auto& q : v.second) {
-                q.clear();
-            }
-        }
+private:
+    template<media::MediaState Ts>
+    using StageQueues = std::array<media::BufferQueue<media::MediaItem<Ts>>, 2>;
 
-        for (auto& v : videoFrames_) {
-            for (auto& q : v.second) {
-                q.clear();
-            }
-        }
+    template<media::MediaType Tt, media::MediaState Ts>
+    media::BufferQueue<media::MediaItem<Ts>>& queue() {
+        return std::get<static_cast<size_t>(Ts)>(stages_)[static_cast<size_t>(Tt)];
+    }
+
+    template<media::MediaType Tt, media::MediaState Ts>
+    const media::BufferQueue<media::MediaItem<Ts>>& queue() const {
+        return std::get<static_cast<size_t>(Ts)>(stages_)[static_cast<size_t>(Tt)];
+    }
+
+    template<media::MediaType Tt, media::MediaState Ts>
+    void setupQueue(const media::MediaLimit& limit) {
+        auto& q = queue<Tt, Ts>();
+        q.setLimit(limit.minSize, limit.maxSize);
+        q.setBudget(limit.maxBytes, limit.maxDuration);
+        q.setClearCallback([this](media::MediaItem<Ts>* item) {
+            release(item);
+            });
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint64_t nextId() {
+        static std::atomic<uint64_t> counter(0);
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    template<typename F>
+    void forEachQueue(F&& f) {
+        std::apply([&f](auto&... stage) {
+            (f(stage[media::VIDEO]), ...);
+            (f(stage[media::AUDIO]), ...);
+            }, stages_);
+    }
+
+    void release(AVPacket* p) {
+        packetPool_.release(p);
+    }
 
-        for (auto& v : audioFrames_) {
-            for (auto& q : v.second) {
-                q.clear();
-            }
+    void release(AVFrame* f) {
+        if (f) {
+            av_frame_free(&f);
         }
     }
 
 private:
-    std::unordered_map<media::MediaState, std::vector<media::MediaQueue<AVPacket>>> videoPackets_;
-    std::unordered_map<media::MediaState, std::vector<media::MediaQueue<AVPacket>>> audioPackets_;
-    std::unordered_map<media::MediaState, std::vector<media::MediaQueue<AVFrame>>> videoFrames_;
-    std::unordered_map<media::MediaState, std::vector<media::MediaQueue<AVFrame>>> audioFrames_;
+    const uint64_t id_;
+    std::atomic<int64_t> serial_;
+    std::atomic<int64_t> seekTarget_;
+    std::atomic<int64_t> seekStart_;
+    media::MediaPacketPool packetPool_;
+    std::tuple<StageQueues<media::DEMUXING>,
+               StageQueues<media::DECODING>,
+               StageQueues<media::ENCODING>> stages_;
 };
\ No newline at end of file
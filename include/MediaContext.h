@@ -1,15 +1,21 @@
 #pragma once
 
 #include <mutex>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
 #include "FFmpeg.h"
 #include "MediaInput.h"
 #include "MediaDecoder.h"
 #include "MediaResampler.h"
+#include "DecodeThreading.h"
 
-#define MCTX() MediaContext::instance()
-
+// One opened input with its decoders and resamplers. Every player session owns its own
+// instance and hands it to its pipeline threads, so several pipelines can run side by side.
 class MediaContext {
 public:
     MediaContext(const MediaContext&) = delete;
@@ -21,13 +27,47 @@ public:
     static constexpr AVSampleFormat TARGET_SAMPLE_FORMAT = AV_SAMPLE_FMT_S16;
     static constexpr AVChannelLayout TARGET_CHANNEL_LAYOUT = AV_CHANNEL_LAYOUT_STEREO;
 
+    // MediaInput opens the input and probes the streams in a single call, so OpenInput
+    // covers both avformat_open_input and avformat_find_stream_info.
+    enum class OpenStage {
+        OpenInput,
+        OpenDecoder,
+        OpenResampler,
+    };
+
+    // elapsed is the duration of the finished stage in microseconds.
+    using StageCallback = std::function<void(uint64_t id, OpenStage stage, int64_t elapsed)>;
+    using FinishCallback = std::function<void(uint64_t id, int ret, const std::string& error)>;
+
+    MediaContext();
     ~MediaContext();
-    static MediaContext* instance();
 
     int playFileStream(const std::string& url);
     int playNetworkStream(const std::string& url);
     void reset();
 
+    // Opens url on a worker thread and installs the result when it succeeds. The callbacks
+    // run on the worker; once another openAsync() or cancelOpen() is issued, or the context
+    // is destroyed, the request is abandoned at the next stage and none of its callbacks are
+    // called any more. The worker is never joined, it may outlive the context.
+    uint64_t openAsync(const std::string& url, bool network, StageCallback onStage, FinishCallback onFinish);
+    void cancelOpen();
+
+    // Audio is resampled to samplerate instead of the source rate by the next open, so a
+    // following playlist item can feed an audio device that is already running. 0 keeps
+    // the source rate.
+    void setOutputSampleRate(int samplerate);
+    int outputSampleRate() const;
+
+    // Applies from the next open. The video decoder is opened here rather than by
+    // MediaDecoder because the threading options must be set before avcodec_open2.
+    void setDecodeThreading(const media::DecodeThreadPolicy& policy);
+    media::DecodeThreadPolicy decodeThreading() const;
+    AVCodecContext* videoDecoder() const;
+    // For the bound video decode thread only: replaces the video decoder with one using
+    // threads threads and frees the previous one.
+    AVCodecContext* reopenVideoDecoder(int threads);
+
     std::string url() const;
     std::string error() const;
     media::MediaInput* mediaInput() const;
@@ -35,15 +75,38 @@ public:
     media::MediaResampler* mediaResampler() const;
 
 private:
-    MediaContext();
+    struct OpenOptions {
+        int samplerate = 0;
+        media::DecodeThreadPolicy threading;
+    };
 
-    int openDecoder();
-    int openResampler();
+    struct Streams {
+        std::unique_ptr<media::MediaInput> input;
+        std::unique_ptr<media::MediaDecoder> decoder;
+        std::unique_ptr<media::MediaResampler> resampler;
+        media::CodecContextPtr video;
+        OpenOptions options;
+    };
 
-private:
-    static std::unique_ptr<MediaContext> instance_;
-    static std::once_flag flag_;
+    // Shared with the open workers. owner is cleared under mutex when the context is
+    // destroyed, so an abandoned worker never touches it afterwards.
+    struct OpenState {
+        std::mutex mutex;
+        uint64_t serial = 0;
+        MediaContext* owner = nullptr;
+    };
+
+    int playStream(const std::string& url, bool network);
+    void install(const std::string& url, Streams& streams);
 
+    static int openStreams(const std::string& url, bool network, const OpenOptions& options, Streams& streams, std::string& error,
+                           const std::function<bool(OpenStage, int64_t)>& onStage);
+    static int openDecoder(Streams& streams, std::string& error);
+    static int openVideoCodec(AVFormatContext* inputCtx, int index, const media::DecodeThreadPolicy& policy,
+                              int threads, media::CodecContextPtr& codecCtx);
+    static int openResampler(Streams& streams, std::string& error);
+
+private:
     mutable std::mutex mutex_;
     std::string url_;
     std::string error_;
@@ -51,4 +114,10 @@ private:
     std::unique_ptr<media::MediaInput> mediaInput_;
     std::unique_ptr<media::MediaDecoder> mediaDecoder_;
     std::unique_ptr<media::MediaResampler> mediaResampler_;
+    media::CodecContextPtr videoDecoder_;
+    OpenOptions openedOptions_;
+
+    // open_->mutex also guards options_.
+    std::shared_ptr<OpenState> open_;
+    OpenOptions options_;
 };
\ No newline at end of file
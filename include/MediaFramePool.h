@@ -0,0 +1,45 @@
+#pragma once
+
+#include "FFmpeg.h"
+
+namespace media {
+
+    // AVBufferPool backed storage for converted frames. The pools are sized for the current
+    // stream and only re-created when the format, size or channel layout changes; buffers
+    // handed out before a change stay valid until their frames are freed.
+    class MediaFramePool {
+    public:
+        MediaFramePool(const MediaFramePool&) = delete;
+        MediaFramePool& operator=(const MediaFramePool&) = delete;
+        MediaFramePool(MediaFramePool&&) = delete;
+        MediaFramePool& operator=(MediaFramePool&&) = delete;
+
+        MediaFramePool();
+        ~MediaFramePool();
+
+        int configVideo(AVPixelFormat format, int width, int height);
+        int configAudio(AVSampleFormat format, const AVChannelLayout& layout, int samples);
+        // Planes below firstPlane are left to the caller, e.g. to reference a plane of
+        // another frame instead of copying it.
+        int getBuffer(AVFrame* frame, int firstPlane = 0);
+        void reset();
+
+    private:
+        int createPools(const size_t sizes[], int planes);
+        void releasePools();
+
+    private:
+        static constexpr int ALIGN = 64;
+
+        AVBufferPool* pools_[AV_NUM_DATA_POINTERS];
+        int linesize_[AV_NUM_DATA_POINTERS];
+        int planes_;
+
+        int format_;
+        int width_;
+        int height_;
+        int samples_;
+        AVChannelLayout layout_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "FFmpeg.h"
+
+namespace media {
+
+    struct MediaPoolStats {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    // Recycles AVPacket shells between the demuxer and the decoders. The payload buffers are
+    // reference counted by libavformat, so a released packet is unreferenced and only the
+    // shell is kept; at most maxSize shells are cached. av_read_frame still allocates every
+    // payload, copying it into a pooled buffer would only add a memcpy on top, so packet
+    // allocation does not drop to zero in steady state, only the shell churn goes away.
+    class MediaPacketPool {
+    public:
+        MediaPacketPool(const MediaPacketPool&) = delete;
+        MediaPacketPool& operator=(const MediaPacketPool&) = delete;
+        MediaPacketPool(MediaPacketPool&&) = delete;
+        MediaPacketPool& operator=(MediaPacketPool&&) = delete;
+
+        explicit MediaPacketPool(size_t maxSize = 512)
+            : maxSize_(maxSize)
+            , hits_(0)
+            , misses_(0) {
+            packets_.reserve(maxSize_);
+        }
+
+        ~MediaPacketPool() {
+            std::lock_guard<std::mutex> locker(mutex_);
+            for (AVPacket* p : packets_) {
+                av_packet_free(&p);
+            }
+            packets_.clear();
+        }
+
+        AVPacket* acquire() {
+            {
+                std::lock_guard<std::mutex> locker(mutex_);
+                if (!packets_.empty()) {
+                    AVPacket* p = packets_.back();
+                    packets_.pop_back();
+                    hits_.fetch_add(1, std::memory_order_relaxed);
+                    return p;
+                }
+            }
+
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return av_packet_alloc();
+        }
+
+        void release(AVPacket* p) {
+            if (!p) {
+                return;
+            }
+
+            av_packet_unref(p);
+
+            {
+                std::lock_guard<std::mutex> locker(mutex_);
+                if (packets_.size() < maxSize_) {
+                    packets_.push_back(p);
+                    return;
+                }
+            }
+
+            av_packet_free(&p);
+        }
+
+        MediaPoolStats stats() const {
+            return { hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed) };
+        }
+
+    private:
+        std::mutex mutex_;
+        std::vector<AVPacket*> packets_;
+        size_t maxSize_;
+        std::atomic<uint64_t> hits_;
+        std::atomic<uint64_t> misses_;
+    };
+
+} // namespace media
\ No newline at end of file
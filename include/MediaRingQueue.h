@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <functional>
+
+namespace media {
+
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    // Bounded single-producer/single-consumer ring. enqueue() may only be called from one
+    // thread and dequeue() from one other thread; neither takes a lock. lock() stops both
+    // sides and waits for any in-flight operation to finish, so clear() and setLimit() are
+    // safe from a third thread while locked.
+    template<typename T>
+    class MediaRingQueue {
+    public:
+        MediaRingQueue(const MediaRingQueue&) = delete;
+        MediaRingQueue& operator=(const MediaRingQueue&) = delete;
+        MediaRingQueue& operator=(MediaRingQueue&&) = delete;
+
+        explicit MediaRingQueue(size_t l = 0, size_t r = 1)
+            : head_(0)
+            , cachedTail_(0)
+            , consumerBusy_(false)
+            , tail_(0)
+            , cachedHead_(0)
+            , producerBusy_(false)
+            , locked_(false)
+            , minSize_(l)
+            , maxSize_(r > 0 ? r : 1)
+            , clearCallback_(nullptr) {
+            reserve(maxSize_.load());
+        }
+
+        // Only valid before the queue is shared between threads.
+        MediaRingQueue(MediaRingQueue&& other) noexcept
+            : head_(other.head_.load())
+            , cachedTail_(other.cachedTail_)
+            , consumerBusy_(false)
+            , tail_(other.tail_.load())
+            , cachedHead_(other.cachedHead_)
+            , producerBusy_(false)
+            , locked_(other.locked_.load())
+            , ring_(std::move(other.ring_))
+            , mask_(other.mask_)
+            , minSize_(other.minSize_.load())
+            , maxSize_(other.maxSize_.load())
+            , clearCallback_(std::move(other.clearCallback_)) {
+            other.head_.store(0);
+            other.tail_.store(0);
+            other.cachedTail_ = 0;
+            other.cachedHead_ = 0;
+            other.mask_ = 0;
+        }
+
+        ~MediaRingQueue() {
+            lock();
+            clear();
+        }
+
+        void setClearCallback(std::function<void(T*)> callback) {
+            clearCallback_ = std::move(callback);
+        }
+
+        bool enqueue(T* item) {
+            if (!item || locked_.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            producerBusy_.store(true, std::memory_order_seq_cst);
+            if (locked_.load(std::memory_order_seq_cst)) {
+                producerBusy_.store(false, std::memory_order_release);
+                return false;
+            }
+
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t limit = maxSize_.load(std::memory_order_relaxed);
+            if (tail - cachedHead_ >= limit) {
+                cachedHead_ = head_.load(std::memory_order_acquire);
+                if (tail - cachedHead_ >= limit) {
+                    producerBusy_.store(false, std::memory_order_release);
+                    return false;
+                }
+            }
+
+            ring_[tail & mask_] = item;
+            tail_.store(tail + 1, std::memory_order_release);
+
+            producerBusy_.store(false, std::memory_order_release);
+            return true;
+        }
+
+        T* dequeue() {
+            if (locked_.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+
+            consumerBusy_.store(true, std::memory_order_seq_cst);
+            if (locked_.load(std::memory_order_seq_cst)) {
+                consumerBusy_.store(false, std::memory_order_release);
+                return nullptr;
+            }
+
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == cachedTail_) {
+                cachedTail_ = tail_.load(std::memory_order_acquire);
+                if (head == cachedTail_) {
+                    consumerBusy_.store(false, std::memory_order_release);
+                    return nullptr;
+                }
+            }
+
+            T* item = ring_[head & mask_];
+            head_.store(head + 1, std::memory_order_release);
+
+            consumerBusy_.store(false, std::memory_order_release);
+            return item;
+        }
+
+        size_t size() const {
+            const size_t head = head_.load(std::memory_order_acquire);
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            return tail - head;
+        }
+
+        bool empty() const {
+            return size() == 0;
+        }
+
+        bool full() const {
+            return size() >= maxSize_.load(std::memory_order_relaxed);
+        }
+
+        size_t minSize() const {
+            return minSize_.load(std::memory_order_relaxed);
+        }
+
+        size_t maxSize() const {
+            return maxSize_.load(std::memory_order_relaxed);
+        }
+
+        // Growing past the current capacity reallocates the ring, so callers must hold lock().
+        void setLimit(size_t l, size_t r) {
+            r = r > 0 ? r : 1;
+            minSize_.store(l, std::memory_order_relaxed);
+            if (r > mask_ + 1) {
+                reserve(r);
+            }
+            maxSize_.store(r, std::memory_order_relaxed);
+        }
+
+        void lock() {
+            locked_.store(true, std::memory_order_seq_cst);
+            while (producerBusy_.load(std::memory_order_seq_cst) ||
+                   consumerBusy_.load(std::memory_order_seq_cst)) {
+                std::this_thread::yield();
+            }
+        }
+
+        void unlock() {
+            locked_.store(false, std::memory_order_seq_cst);
+        }
+
+        void clear() {
+            size_t head = head_.load(std::memory_order_acquire);
+            const size_t tail = tail_.load(std::memory_order_acquire);
+
+            for (; head != tail; ++head) {
+                T* item = ring_[head & mask_];
+                ring_[head & mask_] = nullptr;
+                if (item && clearCallback_) {
+                    clearCallback_(item);
+                }
+            }
+
+            head_.store(tail, std::memory_order_release);
+            cachedTail_ = tail;
+            cachedHead_ = tail;
+        }
+
+    private:
+        void reserve(size_t r) {
+            size_t capacity = 1;
+            while (capacity < r) {
+                capacity <<= 1;
+            }
+
+            std::vector<T*> ring(capacity, nullptr);
+            const size_t head = head_.load(std::memory_order_relaxed);
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            for (size_t i = head; i != tail; ++i) {
+                ring[i & (capacity - 1)] = ring_[i & mask_];
+            }
+
+            ring_.swap(ring);
+            mask_ = capacity - 1;
+        }
+
+    private:
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_;
+        size_t cachedTail_;
+        std::atomic<bool> consumerBusy_;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_;
+        size_t cachedHead_;
+        std::atomic<bool> producerBusy_;
+
+        alignas(CACHE_LINE_SIZE) std::atomic<bool> locked_;
+        std::vector<T*> ring_;
+        size_t mask_ = 0;
+        std::atomic<size_t> minSize_;
+        std::atomic<size_t> maxSize_;
+        std::function<void(T*)> clearCallback_;
+    };
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,268 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include <condition_variable>
+#include "MediaBudget.h"
+
+namespace media {
+
+    // Adds blocking enqueue/dequeue and byte/duration budgets on top of a non-blocking
+    // queue. The fast path stays lock-free: the mutex is only touched when the other side
+    // is actually asleep. timeout is in milliseconds, 0 means try once and a negative value
+    // waits until the item fits or wakeup() is called.
+    template<typename Queue, typename T, typename Traits = MediaItemTraits<T>>
+    class MediaWaitQueue {
+    public:
+        MediaWaitQueue(const MediaWaitQueue&) = delete;
+        MediaWaitQueue& operator=(const MediaWaitQueue&) = delete;
+        MediaWaitQueue& operator=(MediaWaitQueue&&) = delete;
+
+        explicit MediaWaitQueue(size_t l = 0, size_t r = 1)
+            : state_(std::make_unique<State>())
+            , queue_(l, r) {
+            setClearCallback(nullptr);
+        }
+
+        MediaWaitQueue(MediaWaitQueue&& other) noexcept = default;
+
+        void setClearCallback(std::function<void(T*)> callback) {
+            State* state = state_.get();
+            queue_.setClearCallback([state, callback](T* item) {
+                release(state, item);
+                if (callback) {
+                    callback(item);
+                }
+                });
+        }
+
+        bool enqueue(T* item, int timeout = 0) {
+            if (!item) {
+                return false;
+            }
+
+            const size_t bytes = Traits::bytes(item);
+            const int64_t duration = Traits::duration(item);
+            auto tryEnqueue = [this, item, bytes, duration]() {
+                if (overBudget()) {
+                    return false;
+                }
+
+                acquire(bytes, duration);
+                if (queue_.enqueue(item)) {
+                    return true;
+                }
+
+                release(state_.get(), bytes, duration);
+                return false;
+                };
+
+            bool ok = tryEnqueue();
+            if (!ok && timeout != 0) {
+                ok = wait(state_->producers, state_->notFull, state_->producerEpoch, timeout, tryEnqueue);
+            }
+
+            if (ok) {
+                notify(state_->consumers, state_->notEmpty);
+            }
+
+            return ok;
+        }
+
+        T* dequeue(int timeout = 0) {
+            T* item = queue_.dequeue();
+            if (!item && timeout != 0) {
+                wait(state_->consumers, state_->notEmpty, state_->consumerEpoch, timeout, [this, &item]() {
+                    item = queue_.dequeue();
+                    return item != nullptr;
+                    });
+            }
+
+            if (item) {
+                release(state_.get(), item);
+                notify(state_->producers, state_->notFull);
+                MediaMemoryBudget::notify();
+            }
+
+            return item;
+        }
+
+        size_t size() const {
+            return queue_.size();
+        }
+
+        bool empty() const {
+            return queue_.empty();
+        }
+
+        bool full() const {
+            return queue_.full() || overBudget();
+        }
+
+        size_t bytes() const {
+            return state_->bytes.load(std::memory_order_relaxed);
+        }
+
+        double duration() const {
+            return state_->duration.load(std::memory_order_relaxed) / static_cast<double>(AV_TIME_BASE);
+        }
+
+        void setLimit(size_t l, size_t r) {
+            queue_.setLimit(l, r);
+        }
+
+        // 0 disables the corresponding limit.
+        void setBudget(size_t maxBytes, double maxDuration) {
+            state_->maxBytes.store(maxBytes);
+            state_->maxDuration.store(maxDuration > 0.0 ? static_cast<int64_t>(maxDuration * AV_TIME_BASE) : 0);
+            notify(state_->producers, state_->notFull);
+        }
+
+        void lock() {
+            queue_.lock();
+            wakeup();
+        }
+
+        void unlock() {
+            queue_.unlock();
+        }
+
+        void clear() {
+            queue_.clear();
+            notify(state_->producers, state_->notFull);
+            MediaMemoryBudget::notify();
+        }
+
+        // Cancels the wait in progress on each side, or the next one if that side is not
+        // waiting yet, so a caller that checked its state just before waiting cannot miss it.
+        // The cancelled call returns without an item.
+        void wakeup() {
+            {
+                std::lock_guard<std::mutex> locker(state_->mutex);
+                state_->epoch.fetch_add(1);
+                state_->notEmpty.notify_all();
+                state_->notFull.notify_all();
+            }
+            MediaMemoryBudget::notify();
+        }
+
+    private:
+        struct State {
+            std::mutex mutex;
+            std::condition_variable notEmpty;
+            std::condition_variable notFull;
+            std::atomic<int> producers{ 0 };
+            std::atomic<int> consumers{ 0 };
+            std::atomic<uint64_t> epoch{ 0 };
+            std::atomic<uint64_t> producerEpoch{ 0 };
+            std::atomic<uint64_t> consumerEpoch{ 0 };
+            std::atomic<size_t> bytes{ 0 };
+            std::atomic<int64_t> duration{ 0 };
+            std::atomic<size_t> maxBytes{ 0 };
+            std::atomic<int64_t> maxDuration{ 0 };
+        };
+
+        // A queue always admits its first item so one oversized frame cannot stall the pipeline.
+        bool overBudget() const {
+            if (queue_.empty()) {
+                return false;
+            }
+
+            const size_t maxBytes = state_->maxBytes.load(std::memory_order_relaxed);
+            if (maxBytes > 0 && state_->bytes.load(std::memory_order_relaxed) >= maxBytes) {
+                return true;
+            }
+
+            const int64_t maxDuration = state_->maxDuration.load(std::memory_order_relaxed);
+            if (maxDuration > 0 && state_->duration.load(std::memory_order_relaxed) >= maxDuration) {
+                return true;
+            }
+
+            return MediaMemoryBudget::exceeded();
+        }
+
+        void acquire(size_t bytes, int64_t duration) {
+            state_->bytes.fetch_add(bytes, std::memory_order_relaxed);
+            state_->duration.fetch_add(duration, std::memory_order_relaxed);
+            MediaMemoryBudget::add(bytes);
+        }
+
+        static void release(State* state, size_t bytes, int64_t duration) {
+            state->bytes.fetch_sub(bytes, std::memory_order_relaxed);
+            state->duration.fetch_sub(duration, std::memory_order_relaxed);
+            MediaMemoryBudget::sub(bytes);
+        }
+
+        static void release(State* state, const T* item) {
+            release(state, Traits::bytes(item), Traits::duration(item));
+        }
+
+        // seen is the last epoch this side was cancelled at, a wakeup() since then cancels
+        // the wait straight away.
+        template<typename Predicate>
+        bool wait(std::atomic<int>& waiting, std::condition_variable& cv, std::atomic<uint64_t>& seen,
+                  int timeout, Predicate ready) {
+            const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+            const uint64_t epoch = seen.load();
+
+            waiting.fetch_add(1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool ok = false;
+            {
+                std::unique_lock<std::mutex> locker(state_->mutex);
+                while (!(ok = ready())) {
+                    const uint64_t current = state_->epoch.load();
+                    if (current != epoch) {
+                        seen.store(current);
+                        break;
+                    }
+
+                    // Held back by the process-wide cap: wait where releases from any queue
+                    // are signalled. Draining this queue also admits the next item.
+                    if (&cv == &state_->notFull && MediaMemoryBudget::exceeded()) {
+                        locker.unlock();
+                        const bool inTime = MediaMemoryBudget::wait(timeout < 0 ? nullptr : &deadline, [this, epoch]() {
+                            return state_->epoch.load() != epoch || queue_.empty();
+                            });
+                        locker.lock();
+
+                        if (!inTime) {
+                            ok = ready();
+                            break;
+                        }
+                        continue;
+                    }
+
+                    if (timeout < 0) {
+                        cv.wait(locker);
+                    }
+                    else if (cv.wait_until(locker, deadline) == std::cv_status::timeout) {
+                        ok = ready();
+                        break;
+                    }
+                }
+            }
+            waiting.fetch_sub(1);
+
+            return ok;
+        }
+
+        void notify(std::atomic<int>& waiting, std::condition_variable& cv) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waiting.load() > 0) {
+                std::lock_guard<std::mutex> locker(state_->mutex);
+                cv.notify_all();
+            }
+        }
+
+    private:
+        std::unique_ptr<State> state_;
+        Queue queue_;
+    };
+
+} // namespace media
\ No newline at end of file
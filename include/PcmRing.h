@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace media {
+
+    // Single-producer/single-consumer byte ring for interleaved PCM. write() may only be
+    // called from one thread and read() from one other thread; neither locks nor allocates.
+    // clear() needs both sides stopped, the caller provides that exclusion.
+    class PcmRing {
+    public:
+        PcmRing(const PcmRing&) = delete;
+        PcmRing& operator=(const PcmRing&) = delete;
+        PcmRing(PcmRing&&) = delete;
+        PcmRing& operator=(PcmRing&&) = delete;
+
+        PcmRing()
+            : head_(0)
+            , tail_(0)
+            , mask_(0) {
+        }
+
+        // Rounded up to a power of two. Not thread safe, call before the ring is shared.
+        void reserve(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity) {
+                size <<= 1;
+            }
+            ring_.assign(size, 0);
+            mask_ = size - 1;
+            head_.store(0);
+            tail_.store(0);
+        }
+
+        size_t write(const uint8_t* data, size_t size) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t head = head_.load(std::memory_order_acquire);
+            size = std::min(size, ring_.size() - (tail - head));
+            copy(tail, data, size);
+            tail_.store(tail + size, std::memory_order_release);
+            return size;
+        }
+
+        size_t read(uint8_t* data, size_t size) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            const size_t tail = tail_.load(std::memory_order_acquire);
+            size = std::min(size, tail - head);
+
+            const size_t offset = head & mask_;
+            const size_t first = std::min(size, ring_.size() - offset);
+            memcpy(data, ring_.data() + offset, first);
+            memcpy(data + first, ring_.data(), size - first);
+
+            head_.store(head + size, std::memory_order_release);
+            return size;
+        }
+
+        size_t size() const {
+            return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const {
+            return ring_.size();
+        }
+
+        void clear() {
+            head_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+    private:
+        void copy(size_t tail, const uint8_t* data, size_t size) {
+            const size_t offset = tail & mask_;
+            const size_t first = std::min(size, ring_.size() - offset);
+            memcpy(ring_.data() + offset, data, first);
+            memcpy(ring_.data(), data + first, size - first);
+        }
+
+    private:
+        alignas(64) std::atomic<size_t> head_;
+        alignas(64) std::atomic<size_t> tail_;
+        std::vector<uint8_t> ring_;
+        size_t mask_;
+    };
+
+} // namespace media
\ No newline at end of file
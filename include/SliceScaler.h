@@ -0,0 +1,89 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+#include "FFmpeg.h"
+
+namespace media {
+
+    // Pixel format conversion split into bands of output rows, each with its own SwsContext
+    // and worker thread. submit() returns right away so the caller can decode the next frame
+    // while the previous one is converted; wait() collects the result. Each band reads the
+    // whole source through the sws slice API, so scaling and vertical chroma resampling see
+    // the rows beyond its edges. Bands are aligned so no chroma row straddles two of them.
+    class SliceScaler {
+    public:
+        SliceScaler(const SliceScaler&) = delete;
+        SliceScaler& operator=(const SliceScaler&) = delete;
+        SliceScaler(SliceScaler&&) = delete;
+        SliceScaler& operator=(SliceScaler&&) = delete;
+
+        SliceScaler();
+        ~SliceScaler();
+
+        // slices of 0 picks the count from the height and the number of cores. Only rebuilds
+        // the contexts when something changed.
+        int config(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
+                   int dstWidth, int dstHeight, AVPixelFormat dstFormat, int slices = 0);
+
+        // Takes a reference to src. dst must already have its buffers and stay untouched
+        // until wait() returns.
+        int submit(const AVFrame* src, AVFrame* dst);
+
+        // Conversion time of the submitted frame in microseconds, or a negative error.
+        int64_t wait();
+
+        bool busy() const;
+        void reset();
+
+    private:
+        struct Slice {
+            SwsContext* ctx;
+            int y;
+            int height;
+        };
+
+        void startWorkers(size_t count);
+        void stopWorkers();
+        void releaseSlices();
+        void worker(size_t index, uint64_t seen);
+        int convert(const Slice& slice);
+
+        static int64_t now();
+
+    private:
+        static constexpr int ALIGN = 16;
+        static constexpr int MIN_SLICE_HEIGHT = 256;
+
+        std::vector<Slice> slices_;
+        std::vector<std::thread> workers_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable jobWc_;
+        std::condition_variable doneWc_;
+
+        AVFrame* src_;
+        AVFrame* dst_;
+
+        int srcWidth_;
+        int srcHeight_;
+        int srcFormat_;
+        int dstWidth_;
+        int dstHeight_;
+        int dstFormat_;
+
+        uint64_t job_;
+        size_t remaining_;
+        int error_;
+        int64_t start_;
+        int64_t elapsed_;
+        bool busy_;
+        bool quit_;
+    };
+
+} // namespace media
\ No newline at end of file
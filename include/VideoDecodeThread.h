@@ -1,47 +1,151 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <cmath>
+#include <utility>
+#include <algorithm>
+#include <QMutex>
 #include <QString>
 #include <QThread>
+#include <QWaitCondition>
 #include "MediaBuffer.h"
 #include "MediaContext.h"
+#include "SliceScaler.h"
+#include "MediaFramePool.h"
 
 class VideoDecodeThread : public QThread {
     Q_OBJECT
 
 public:
-    explicit VideoDecodeThread(QObject* parent = nullptr, std::shared_ptr<MediaBuffer> buffer = nullptr);
+    explicit VideoDecodeThread(QObject* parent = nullptr);
     ~VideoDecodeThread();
 
     void start();
     void stop();
-
-public slots:
-    void onFlushRequest();
+    bool bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    void unbind();
+    QString bindError() const;
+    void setSpeed(float speed);
+    // Viewport size in device pixels, 0 keeps the source size.
+    void setOutputSize(int width, int height);
+    // 0 decodes everything, every step up trades picture quality for decode time.
+    int degradeLevel() const;
 
 signals:
     void videoDecodeError(const QString& error);
+    void seekReached(qint64 elapsed);
+    void degradeLevelChanged(int level);
+    void frameConverted(qint64 elapsed);
 
 protected:
     void run() override;
 
 private:
+    enum class OutputPath {
+        Direct,
+        SplitChroma,
+        Convert,
+    };
+
     void processFrame();
+    void splitChroma();
+    void updateOutputSize(int width, int height);
+    void startConversion();
+    void reportConvertError();
+    void finishConversion();
+    void discardConversion();
+    bool enqueueFrame(AVFrame* frame);
+    void updateSkipFrame(const AVPacket* packet);
+    bool beforeSeekTarget(const AVFrame* frame) const;
     void flushDecoder();
+    void processEndOfStream();
+    void updateTuning();
+    void resetTuning();
+    void reopenDecoder();
+    void updateGovernor();
+    void resetGovernor();
+    void applyDegradeLevel();
+    AVDiscard skipFrameBase() const;
+    static OutputPath outputPath(int format);
+    static int64_t now();
+    void park();
     void cleanup();
 
 private:
+    std::shared_ptr<MediaContext> context_;
     std::shared_ptr<MediaBuffer> buffer_;
     AVCodecContext* decCtx_;
-    SwsContext* swsCtx_;
     AVFrame* decFrm_;
-    AVFrame* yuvFrm_;
+    AVFrame* convFrm_;
+    media::MediaFramePool framePool_;
+    media::SliceScaler scaler_;
+
+    QMutex bindMutex_;
+    QWaitCondition bindWc_;
 
     QString initError_;
+    QString bindError_;
+    media::DecodeThreadPolicy policy_;
+    double frameRate_;
+    int64_t serial_;
+    int64_t seekTarget_;
+    int64_t tuneStart_;
+    int64_t busyTime_;
+    int decodedFrames_;
+    int pendingThreads_;
+    int64_t govStart_;
+    int64_t govBusy_;
+    int govPackets_;
+    int govHold_;
+    int srcWidth_;
+    int srcHeight_;
+    int outWidth_;
+    int outHeight_;
+    bool scaleFailed_;
+    bool convertFailed_;
+    bool parked_;
 
     std::atomic<bool> inited_;
-    std::atomic<bool> flush_;
+    std::atomic<bool> bound_;
     std::atomic<bool> running_;
     std::atomic<bool> started_;
+    std::atomic<float> speed_;
+    std::atomic<int> viewWidth_;
+    std::atomic<int> viewHeight_;
+    std::atomic<int> degradeLevel_;
+
+    // Decode rate is measured over at least TUNE_INTERVAL (microseconds) and TUNE_FRAMES frames.
+    static constexpr int64_t TUNE_INTERVAL = 2000000;
+    static constexpr int TUNE_FRAMES = 30;
+    // Relative size change needed before the output size follows the viewport.
+    static constexpr double OUTPUT_HYSTERESIS = 0.15;
+
+    // Governor load is decoder time over the playback time of the packets decoded in a
+    // window of GOVERNOR_INTERVAL (microseconds). Above STEP_UP, or above STEP_UP_STARVED
+    // with an empty frame queue, it degrades one step; it only steps back after
+    // GOVERNOR_HOLD windows below STEP_DOWN.
+    static constexpr int64_t GOVERNOR_INTERVAL = 500000;
+    static constexpr int GOVERNOR_PACKETS = 10;
+    static constexpr int GOVERNOR_HOLD = 4;
+    static constexpr double STEP_UP = 0.9;
+    static constexpr double STEP_UP_STARVED = 0.7;
+    static constexpr double STEP_DOWN = 0.5;
+
+    struct DegradeStep {
+        AVDiscard loopFilter;
+        AVDiscard idct;
+        AVDiscard frame;
+    };
+
+    static constexpr DegradeStep DEGRADE_STEPS[] = {
+        { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+        { AVDISCARD_NONREF,  AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+        { AVDISCARD_ALL,     AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+        { AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+        { AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_NONREF  },
+        { AVDISCARD_ALL,     AVDISCARD_NONREF,  AVDISCARD_NONKEY  },
+    };
+    static constexpr int DEGRADE_LEVELS = static_cast<int>(sizeof(DEGRADE_STEPS) / sizeof(DEGRADE_STEPS[0]));
 };
\ No newline at end of file
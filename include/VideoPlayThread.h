@@ -1,12 +1,18 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
 #include <memory>
+#include <thread>
+#include <cstdlib>
+#include <algorithm>
 #include <QMutex>
 #include <QString>
 #include <QThread>
 #include <QWaitCondition>
 #include "YUVRenderer.h"
+#include "AudioClock.h"
+#include "FrameTiming.h"
 #include "MediaBuffer.h"
 #include "MediaContext.h"
 #include "AVSyncManager.h"
@@ -15,44 +21,106 @@ class VideoPlayThread : public QThread {
     Q_OBJECT
 
 public:
-    explicit VideoPlayThread(QObject* parent = nullptr, YUVRenderer* yuvRenderer = nullptr, std::shared_ptr<MediaBuffer> buffer = nullptr);
+    // Counted since the last bind. Late frames were shown behind the audio clock, dropped
+    // ones were already over when dequeued and a newer frame was waiting.
+    struct FrameStats {
+        quint64 onTime;
+        quint64 late;
+        quint64 dropped;
+    };
+
+    explicit VideoPlayThread(QObject* parent = nullptr, YUVRenderer* yuvRenderer = nullptr);
     ~VideoPlayThread();
 
     void start();
     void stop();
+    bool bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    void unbind();
+    QString bindError() const;
     void pause();
     void resume();
     void setSpeed(float speed);
     double getCurrentTime() const;
-
-public slots:
-    void onFlushRequest();
-    void onUpdateAudioClock(double pts, double duration);
+    FrameStats frameStats() const;
+    const media::FrameTimingHistogram& frameTiming() const;
+    void setNextSource(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer);
+    // Set before start(), the clock the audio play thread publishes into.
+    void setAudioClock(std::shared_ptr<media::AudioClock> clock);
 
 signals:
     void videoPlayError(const QString& error);
+    void firstFrame();
+    void sourceSwitched();
 
 protected:
     void run() override;
 
 private:
-    int processFrame(AVFrame* frame);
+    void presentFrame(AVFrame* frame);
+    bool processFrame(AVFrame* frame);
+    int64_t frameDeadline(double pts);
+    bool waitUntil(int64_t deadline);
+    bool dropLateFrame(const AVFrame* frame);
+    bool masterClock(double& clock, double* duration = nullptr) const;
+    void resetFrameStats();
+    static int64_t now();
+    bool switchSource();
+    void park();
 
 private:
     YUVRenderer* yuvRenderer_;
+    std::shared_ptr<MediaContext> context_;
     std::shared_ptr<MediaBuffer> buffer_;
+    std::shared_ptr<MediaContext> nextContext_;
+    std::shared_ptr<MediaBuffer> nextBuffer_;
     std::unique_ptr<media::AVSyncManager> avsyncManager_;
+    std::shared_ptr<media::AudioClock> audioClock_;
 
     QMutex mutex_;
     QMutex pauseMutex_;
+    QMutex bindMutex_;
     QWaitCondition pauseWc_;
+    QWaitCondition bindWc_;
 
     QString initError_;
+    QString bindError_;
     float speed_;
+    int64_t serial_;
+    bool ended_;
+    bool parked_;
+    AVFrame* pending_;
+    int64_t anchorTime_;
+    double anchorPts_;
 
     std::atomic<bool> inited_;
+    std::atomic<bool> bound_;
     std::atomic<bool> paused_;
     std::atomic<bool> running_;
     std::atomic<bool> started_;
+    std::atomic<bool> firstFrame_;
+    std::atomic<quint64> item_;
     std::atomic<double> currentTime_;
+    std::atomic<quint64> onTimeFrames_;
+    std::atomic<quint64> lateFrames_;
+    std::atomic<quint64> droppedFrames_;
+    std::atomic<bool> reanchor_;
+    media::FrameTimingHistogram timing_;
+
+    // Seconds. A frame counts as late once shown LATE_TOLERANCE behind the audio clock and
+    // is dropped once its whole duration plus DROP_TOLERANCE lies behind it. An audio clock
+    // sample older than CLOCK_MAX_AGE (microseconds), e.g. while paused, is not extrapolated.
+    static constexpr double LATE_TOLERANCE = 0.02;
+    static constexpr double DROP_TOLERANCE = 0.01;
+    static constexpr int64_t CLOCK_MAX_AGE = 500000;
+
+    // Microseconds. Waits sleep in slices of at most SLEEP_SLICE to notice pause, seek and
+    // stop, and spin through the last SPIN_WINDOW. Deadlines further than RESYNC from the
+    // audio clock jump to it, smaller differences are corrected by 1/DRIFT_DIVISOR per
+    // frame. Deadlines more than LATE_RESET behind or AHEAD_RESET ahead restart the clock.
+    static constexpr int64_t SLEEP_SLICE = 10000;
+    static constexpr int64_t SPIN_WINDOW = 1000;
+    static constexpr int64_t RESYNC = 40000;
+    static constexpr int64_t DRIFT_DIVISOR = 16;
+    static constexpr int64_t LATE_RESET = 100000;
+    static constexpr int64_t AHEAD_RESET = 1000000;
 };
\ No newline at end of file
@@ -1,15 +1,20 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <utility>
 #include <QTimer>
 #include <QWidget>
 #include <QFileInfo>
+#include <QStringList>
 #include <QMessageBox>
+#include <QElapsedTimer>
 #include <QtWidgets/QMainWindow>
 #include "VideoPlayerUi.h"
 #include "MediaBuffer.h"
 #include "MediaContext.h"
 #include "DemuxThread.h"
+#include "KeyframeIndexThread.h"
 #include "VideoPlayThread.h"
 #include "AudioPlayThread.h"
 #include "VideoDecodeThread.h"
@@ -22,15 +27,31 @@ public:
     explicit VideoPlayer(QWidget* parent = nullptr);
     ~VideoPlayer();
 
+    void playPlaylist(const QStringList& files, bool loop);
+    void setDecodeThreading(const media::DecodeThreadPolicy& policy);
+
 private slots:
     void onLoadLocalVideo(const QString& filePath);
+    void onLoadPlaylist(const QStringList& files);
     void onLoadNetworkVideo(const QString& networkUrl);
     void onPlayRequest();
     void onPauseRequest();
     void onStopRequest();
-    void onSeekRequest(int position);
+    void onSeekRequest(int64_t timestamp);
+    void onSeekRelativeRequest(int64_t offset);
+    void onSeekFinished(qint64 request);
+    void onSeekReached(qint64 elapsed);
+    void onFrameConverted(qint64 elapsed);
+    void onDegradeLevelChanged(int level);
+    void onIndexReady();
+    void onOpenStage(uint64_t id, int stage, int64_t elapsed);
+    void onOpenFinished(uint64_t id, int ret, const QString& error, const QString& url, bool network);
+    void onFirstFrame();
+    void onNextOpened(uint64_t id, int ret, const QString& error);
+    void onSourceSwitched();
     void onSpeedChanged(float speed);
     void onVolumeChanged(int volume);
+    void onViewportResized(const QSize& size);
     void onUpdateProgress();
     void onPlaybackFinished();
     void onErrorOccurred(const QString& error);
@@ -38,11 +59,25 @@ private slots:
 private:
     void setupUi();
     void setupConnections();
-    void setupThreads();
-    void setupThreadConnections();
+    QString setupThreads();
+    DemuxThread* createDemuxThread();
+    VideoDecodeThread* createVideoDecodeThread();
+    AudioDecodeThread* createAudioDecodeThread();
+    void setupIndexThread(const QString& filePath);
+    void openMedia(const QString& url, bool network);
+    void finishLocalLoad(const QString& filePath);
+    void finishNetworkLoad(const QString& networkUrl);
+    int nextPlaylistIndex() const;
+    void prepareNext();
+    void promoteNext();
+    void cleanupNext();
+    void resetNext();
+    int64_t totalDuration() const;
+    int64_t currentPosition() const;
     void handleError(const QString& error);
     void showErrorMessage(const QString& error);
     void cleanup();
+    void destroyThreads();
     void cleanupThread(QThread* thread);
 
 private:
@@ -58,13 +93,50 @@ private:
         Finished,
     } state;
 
+    PlayState resumeState;
+    qint64 pendingSeek;
+    int64_t seekTarget;
+    uint64_t pendingOpen;
+    QElapsedTimer loadTimer;
+
+    // Pixel format conversion time, logged every CONVERT_REPORT_FRAMES frames.
+    struct ConvertStats {
+        int frames = 0;
+        int64_t total = 0;
+        int64_t max = 0;
+    } convertStats;
+    static constexpr int CONVERT_REPORT_FRAMES = 300;
+
     QString filePath;
     QString networkUrl;
 
+    QStringList playlist;
+    int playlistIndex;
+    bool playlistLoop;
+    media::DecodeThreadPolicy decodeThreading;
+
+    // Following playlist item, opened and decoding into its own buffer while the current
+    // one plays. The play threads switch to it at the current item's end of stream. Its
+    // demux and decode threads are a second, persistent set.
+    struct NextItem {
+        int index = -1;
+        uint64_t openId = 0;
+        int switched = 0;
+        std::shared_ptr<MediaContext> context;
+        std::shared_ptr<MediaBuffer> buffer;
+        DemuxThread* demuxThread = nullptr;
+        VideoDecodeThread* videoDecoderThread = nullptr;
+        AudioDecodeThread* audioDecoderThread = nullptr;
+    } next;
+
+    std::shared_ptr<MediaContext> context;
     std::shared_ptr<MediaBuffer> buffer;
+    // Written by the audio callback, read by the video play thread.
+    std::shared_ptr<media::AudioClock> audioClock;
 
     QTimer* progressTimer;
     DemuxThread* demuxThread;
+    KeyframeIndexThread* indexThread;
     VideoDecodeThread* videoDecoderThread;
     AudioDecodeThread* audioDecoderThread;
     VideoPlayThread* videoPlayThread;
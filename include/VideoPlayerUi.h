@@ -6,11 +6,13 @@
 #include <QMimeData>
 #include <QMimeType>
 #include <QFileInfo>
+#include <QStringList>
 #include <QKeyEvent>
 #include <QDropEvent>
 #include <QMouseEvent>
 #include <QVBoxLayout>
 #include <QResizeEvent>
+#include <QSize>
 #include <QMimeDatabase>
 #include <QDragEnterEvent>
 #include <QAbstractItemView>
@@ -25,6 +27,10 @@ class VideoPlayerUi : public QWidget {
     Q_OBJECT
 
 public:
+    // Times are in microseconds (AV_TIME_BASE units).
+    static constexpr int64_t TIME_BASE = 1000000;
+    static constexpr int64_t SEEK_STEP = 5 * TIME_BASE;
+
     explicit VideoPlayerUi(QWidget* parent = nullptr);
     ~VideoPlayerUi() = default;
 
@@ -39,6 +45,7 @@ public:
     float getSpeed()                const { return speed; }
     int getProgress()               const { return progress; }
     int getVolume()                 const { return volume; }
+    QSize getViewportSize() const;
 
     void setTotalTime(int64_t totalTime);
     void setCurrentTime(int64_t currentTime);
@@ -54,13 +61,17 @@ public:
 
 signals:
     void loadLocalVideo(const QString& filePath);
+    void loadPlaylist(const QStringList& files);
     void loadNetworkVideo(const QString& networkUrl);
     void playRequest();
     void pauseRequest();
     void stopRequest();
-    void seekRequest(int position);
+    void seekRequest(int64_t timestamp);
+    void seekRelativeRequest(int64_t offset);
     void speedChanged(float speed);
     void volumeChanged(int volume);
+    // Size of the video area in device pixels.
+    void viewportResized(const QSize& size);
 
 protected:
     void enterEvent(QEvent* event) override;
@@ -109,8 +120,10 @@ private:
     void showTimePreview(int progress);
     void showVolumePreview(int volume);
     QLabel* createPreviewLabel(const QString& styleSheet);
+    int progressOf(int64_t time) const;
+    int64_t timeOf(int progress) const;
     bool isValidVideoFile(const QString& filePath) const;
-    QString formatTime(int64_t seconds) const;
+    QString formatTime(int64_t time) const;
 
 private:
     QVBoxLayout* mainLayout;
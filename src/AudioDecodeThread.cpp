@@ -1,36 +1,23 @@
 #include "AudioDecodeThread.h"
 
-AudioDecodeThread::AudioDecodeThread(QObject* parent, std::shared_ptr<MediaBuffer> buffer)
+AudioDecodeThread::AudioDecodeThread(QObject* parent)
     : QThread(parent)
-    , buffer_(buffer)
     , decCtx_(nullptr)
     , swrCtx_(nullptr)
     , decFrm_(nullptr)
     , pcmFrm_(nullptr)
     , initError_("")
+    , bindError_("")
+    , samplerate_(0)
+    , serial_(0)
+    , seekTarget_(AV_NOPTS_VALUE)
+    , parked_(false)
     , inited_(false)
-    , flush_(false)
+    , bound_(false)
     , running_(false)
     , started_(false) {
 
     do {
-        if (!buffer) {
-            initError_ = "Media buffer is NULL";
-            break;
-        }
-
-        decCtx_ = MCTX()->mediaDecoder()->audioDecoder();
-        if (!decCtx_) {
-            initError_ = "Audio decoder context is NULL";
-            break;
-        }
-
-        swrCtx_ = MCTX()->mediaResampler()->swrContext();
-        if (!swrCtx_) {
-            initError_ = "Swr context is NULL";
-            break;
-        }
-
         decFrm_ = av_frame_alloc();
         pcmFrm_ = av_frame_alloc();
         if (!decFrm_ || !pcmFrm_) {
@@ -49,15 +36,97 @@ AudioDecodeThread::AudioDecodeThread(QObject* parent, std::shared_ptr<MediaBuffe
 
 AudioDecodeThread::~AudioDecodeThread() {
     stop();
+    unbind();
     cleanup();
 }
 
+bool AudioDecodeThread::bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    unbind();
+
+    do {
+        if (!context) {
+            bindError_ = "Media context is NULL";
+            break;
+        }
+
+        if (!buffer) {
+            bindError_ = "Media buffer is NULL";
+            break;
+        }
+
+        AVCodecContext* decCtx = context->mediaDecoder()->audioDecoder();
+        if (!decCtx) {
+            bindError_ = "Audio decoder context is NULL";
+            break;
+        }
+
+        SwrContext* swrCtx = context->mediaResampler()->swrContext();
+        if (!swrCtx) {
+            bindError_ = "Swr context is NULL";
+            break;
+        }
+
+        int samplerate = context->outputSampleRate();
+        if (samplerate <= 0) {
+            bindError_ = "Invalid output samplerate";
+            break;
+        }
+
+        QMutexLocker locker(&bindMutex_);
+        context_ = std::move(context);
+        buffer_ = std::move(buffer);
+        decCtx_ = decCtx;
+        swrCtx_ = swrCtx;
+        samplerate_ = samplerate;
+        serial_ = buffer_->serial();
+        seekTarget_ = AV_NOPTS_VALUE;
+
+        bound_.store(true);
+        bindWc_.wakeAll();
+        return true;
+
+    } while (0);
+
+    return false;
+}
+
+void AudioDecodeThread::unbind() {
+    bound_.store(false);
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
+
+    QMutexLocker locker(&bindMutex_);
+    while (isRunning() && running_.load() && !parked_) {
+        bindWc_.wait(&bindMutex_);
+    }
+
+    if (decFrm_) {
+        av_frame_unref(decFrm_);
+    }
+
+    if (pcmFrm_) {
+        av_frame_unref(pcmFrm_);
+    }
+
+    context_.reset();
+    buffer_.reset();
+    decCtx_ = nullptr;
+    swrCtx_ = nullptr;
+}
+
+QString AudioDecodeThread::bindError() const {
+    return bindError_;
+}
+
 void AudioDecodeThread::start() {
     if (started_.exchange(true)) {
         return;
     }
 
     if (!inited_.load()) {
+        started_.store(false);
         emit audioDecodeError(initError_);
         return;
     }
@@ -71,8 +140,15 @@ void AudioDecodeThread::stop() {
     }
 
     running_.store(false);
-    flush_.store(false);
     requestInterruption();
+    {
+        QMutexLocker locker(&bindMutex_);
+        bindWc_.wakeAll();
+    }
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
 
     if (!wait(3000)) {
         terminate();
@@ -82,31 +158,41 @@ void AudioDecodeThread::stop() {
     started_.store(false);
 }
 
-void AudioDecodeThread::onFlushRequest() {
-    if (!running_.load()) {
-        return;
-    }
-
-    flush_.store(true);
-}
-
 void AudioDecodeThread::run() {
     running_.store(true);
 
     while (running_.load() && !isInterruptionRequested()) {
-        if (flush_.exchange(false)) {
-            avcodec_flush_buffers(decCtx_);
+        if (!bound_.load()) {
+            park();
             continue;
         }
 
-        AVPacket* packet = reinterpret_cast<AVPacket*>(buffer_->dequeue<media::AUDIO, media::DEMUXING>());
+        AVPacket* packet = buffer_->dequeue<media::AUDIO, media::DEMUXING>(media::MediaWait_Infinite);
         if (!packet) {
-            msleep(1);
+            continue;
+        }
+
+        int64_t serial = media::itemSerial(packet);
+        if (serial < buffer_->serial()) {
+            buffer_->releasePacket(packet);
+            continue;
+        }
+
+        if (serial != serial_) {
+            avcodec_flush_buffers(decCtx_);
+            serial_ = serial;
+            seekTarget_ = buffer_->seekTarget(serial);
+        }
+
+        if (media::isEndOfStream(packet)) {
+            buffer_->releasePacket(packet);
+            flushDecoder();
+            processEndOfStream();
             continue;
         }
 
         int ret = avcodec_send_packet(decCtx_, packet);
-        av_packet_free(&packet);
+        buffer_->releasePacket(packet);
 
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
@@ -117,7 +203,7 @@ void AudioDecodeThread::run() {
             }
             else {
                 emit audioDecodeError("Audio decode thread send packet failed");
-                break;
+                bound_.store(false);
             }
             continue;
         }
@@ -140,7 +226,7 @@ void AudioDecodeThread::run() {
         }
 
         if (innerError) {
-            break;
+            bound_.store(false);
         }
     }
 
@@ -152,28 +238,40 @@ void AudioDecodeThread::processFrame() {
         return;
     }
 
-    AVFrame* frame = av_frame_alloc();
-    if (!frame) {
-        return;
-    }
-
     if (decFrm_->pts == AV_NOPTS_VALUE) {
         decFrm_->pts = decFrm_->best_effort_timestamp;
     }
     decFrm_->time_base = decCtx_->time_base;
 
+    if (seekTarget_ != AV_NOPTS_VALUE) {
+        if (!trimToSeekTarget(decFrm_)) {
+            return;
+        }
+
+        seekTarget_ = AV_NOPTS_VALUE;
+        emit seekReached(buffer_->seekElapsed());
+    }
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
     if (decCtx_->ch_layout.nb_channels == MediaContext::TARGET_CHANNEL_LAYOUT.nb_channels &&
-        decCtx_->sample_fmt == MediaContext::TARGET_SAMPLE_FORMAT) {
+        decCtx_->sample_fmt == MediaContext::TARGET_SAMPLE_FORMAT &&
+        decCtx_->sample_rate == samplerate_) {
         av_frame_move_ref(frame, decFrm_);
     }
     else {
         av_frame_unref(pcmFrm_);
-        pcmFrm_->sample_rate = decCtx_->sample_rate;
-        pcmFrm_->nb_samples = decFrm_->nb_samples;
+        pcmFrm_->sample_rate = samplerate_;
+        pcmFrm_->nb_samples = (decCtx_->sample_rate == samplerate_) ? decFrm_->nb_samples
+                                                                    : swr_get_out_samples(swrCtx_, decFrm_->nb_samples);
         pcmFrm_->format = MediaContext::TARGET_SAMPLE_FORMAT;
         av_channel_layout_copy(&pcmFrm_->ch_layout, &MediaContext::TARGET_CHANNEL_LAYOUT);
 
-        if (av_frame_get_buffer(pcmFrm_, 0) < 0) {
+        if (framePool_.configAudio(MediaContext::TARGET_SAMPLE_FORMAT, MediaContext::TARGET_CHANNEL_LAYOUT, pcmFrm_->nb_samples) < 0 ||
+            framePool_.getBuffer(pcmFrm_) < 0) {
             av_frame_free(&frame);
             return;
         }
@@ -192,7 +290,70 @@ void AudioDecodeThread::processFrame() {
         av_frame_move_ref(frame, pcmFrm_);
     }
 
-    bool ok = buffer_->enqueue<AVFrame, media::AUDIO, media::DECODING>(frame);
+    media::setItemSerial(frame, serial_);
+
+    bool ok = false;
+    while (!ok && running_.load() && bound_.load() && serial_ >= buffer_->serial() && !isInterruptionRequested()) {
+        ok = buffer_->enqueue<media::AUDIO, media::DECODING>(frame, media::MediaWait_Infinite);
+    }
+
+    if (!ok) {
+        av_frame_free(&frame);
+    }
+}
+
+// Drops the samples that lie before the seek target by advancing the plane pointers.
+// Returns false when the whole frame is before the target.
+bool AudioDecodeThread::trimToSeekTarget(AVFrame* frame) const {
+    if (frame->pts == AV_NOPTS_VALUE || frame->sample_rate <= 0 || frame->nb_samples <= 0) {
+        return true;
+    }
+
+    int64_t start = av_rescale_q(frame->pts, frame->time_base, AV_TIME_BASE_Q);
+    if (start >= seekTarget_) {
+        return true;
+    }
+
+    int64_t skip = av_rescale(seekTarget_ - start, frame->sample_rate, AV_TIME_BASE);
+    if (skip >= frame->nb_samples) {
+        return false;
+    }
+
+    AVSampleFormat format = static_cast<AVSampleFormat>(frame->format);
+    int planar = av_sample_fmt_is_planar(format);
+    int planes = planar ? frame->ch_layout.nb_channels : 1;
+    int64_t offset = skip * av_get_bytes_per_sample(format) * (planar ? 1 : frame->ch_layout.nb_channels);
+
+    for (int i = 0; i < planes; ++i) {
+        frame->extended_data[i] += offset;
+        if (i < AV_NUM_DATA_POINTERS && frame->extended_data != frame->data) {
+            frame->data[i] += offset;
+        }
+    }
+
+    frame->nb_samples -= static_cast<int>(skip);
+    frame->pts += av_rescale_q(skip, AVRational{ 1, frame->sample_rate }, frame->time_base);
+    if (frame->duration > 0) {
+        frame->duration = av_rescale_q(frame->nb_samples, AVRational{ 1, frame->sample_rate }, frame->time_base);
+    }
+
+    return true;
+}
+
+// Forwarded once the decoder is drained, so the play thread knows the item has ended.
+void AudioDecodeThread::processEndOfStream() {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    media::setItemSerial(frame, serial_);
+
+    bool ok = false;
+    while (!ok && running_.load() && bound_.load() && serial_ >= buffer_->serial() && !isInterruptionRequested()) {
+        ok = buffer_->enqueue<media::AUDIO, media::DECODING>(frame, media::MediaWait_Infinite);
+    }
+
     if (!ok) {
         av_frame_free(&frame);
     }
@@ -220,6 +381,16 @@ void AudioDecodeThread::flushDecoder() {
     }
 }
 
+void AudioDecodeThread::park() {
+    QMutexLocker locker(&bindMutex_);
+    parked_ = true;
+    bindWc_.wakeAll();
+    while (running_.load() && !bound_.load()) {
+        bindWc_.wait(&bindMutex_);
+    }
+    parked_ = false;
+}
+
 void AudioDecodeThread::cleanup() {
     if (decFrm_) {
         av_frame_free(&decFrm_);
@@ -0,0 +1,247 @@
+#include "AudioGain.h"
+
+#if defined(MEDIA_GAIN_X86) && (defined(__GNUC__) || defined(__clang__))
+#define MEDIA_TARGET_SSE2 __attribute__((target("sse2")))
+#define MEDIA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MEDIA_TARGET_SSE2
+#define MEDIA_TARGET_AVX2
+#endif
+
+namespace media {
+
+    void AudioGain::apply(int16_t* samples, size_t count, float from, float to) {
+        static const GainKernel kernel = bestKernel();
+        apply(kernel, samples, count, from, to);
+    }
+
+    void AudioGain::apply(GainKernel kernel, int16_t* samples, size_t count, float from, float to) {
+        if (!samples || count == 0) {
+            return;
+        }
+
+        if (from == to) {
+            if (from == 1.0f) {
+                return;
+            }
+            if (from == 0.0f) {
+                std::fill(samples, samples + count, static_cast<int16_t>(0));
+                return;
+            }
+        }
+
+        const float step = (to - from) / static_cast<float>(count);
+
+        switch (kernel) {
+        case GainKernel::Reference:
+            applyReference(samples, count, to);
+            break;
+#if defined(MEDIA_GAIN_X86)
+        case GainKernel::SSE2:
+            applySSE2(samples, count, from, step);
+            break;
+        case GainKernel::AVX2:
+            applyAVX2(samples, count, from, step);
+            break;
+#endif
+        default:
+            applyScalar(samples, count, from, step);
+            break;
+        }
+    }
+
+    GainKernel AudioGain::bestKernel() {
+        if (supported(GainKernel::AVX2)) {
+            return GainKernel::AVX2;
+        }
+        if (supported(GainKernel::SSE2)) {
+            return GainKernel::SSE2;
+        }
+        return GainKernel::Scalar;
+    }
+
+    bool AudioGain::supported(GainKernel kernel) {
+        switch (kernel) {
+        case GainKernel::Reference:
+        case GainKernel::Scalar:
+            return true;
+#if defined(MEDIA_GAIN_X86)
+        case GainKernel::SSE2:
+#if defined(__x86_64__) || defined(_M_X64)
+            return true;
+#elif defined(_MSC_VER)
+        {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+        }
+#else
+            return __builtin_cpu_supports("sse2");
+#endif
+        case GainKernel::AVX2:
+            return cpuHasAVX2();
+#endif
+        default:
+            return false;
+        }
+    }
+
+    const char* AudioGain::name(GainKernel kernel) {
+        switch (kernel) {
+        case GainKernel::Reference:
+            return "reference";
+        case GainKernel::Scalar:
+            return "scalar";
+        case GainKernel::SSE2:
+            return "sse2";
+        case GainKernel::AVX2:
+            return "avx2";
+        default:
+            return "unknown";
+        }
+    }
+
+    std::vector<GainBenchmark> AudioGain::benchmark(size_t count, int iterations) {
+        std::vector<GainBenchmark> results;
+        if (count == 0 || iterations <= 0) {
+            return results;
+        }
+
+        std::vector<int16_t> source(count);
+        uint32_t seed = 0x12345678;
+        for (int16_t& sample : source) {
+            seed = seed * 1664525u + 1013904223u;
+            sample = static_cast<int16_t>(seed >> 16);
+        }
+
+        std::vector<int16_t> samples(count);
+        for (GainKernel kernel : { GainKernel::Reference, GainKernel::Scalar, GainKernel::SSE2, GainKernel::AVX2 }) {
+            if (!supported(kernel)) {
+                continue;
+            }
+
+            std::chrono::steady_clock::duration elapsed{};
+            for (int i = 0; i < iterations; ++i) {
+                std::copy(source.begin(), source.end(), samples.begin());
+                auto start = std::chrono::steady_clock::now();
+                apply(kernel, samples.data(), count, 0.7f, 0.7f);
+                elapsed += std::chrono::steady_clock::now() - start;
+            }
+
+            double seconds = std::chrono::duration<double>(elapsed).count();
+            double rate = seconds > 0.0 ? static_cast<double>(count) * iterations / seconds : 0.0;
+            results.push_back({ kernel, rate });
+        }
+
+        return results;
+    }
+
+    void AudioGain::applyReference(int16_t* samples, size_t count, float gain) {
+        for (size_t i = 0; i < count; ++i) {
+            int32_t temp = static_cast<int32_t>(samples[i] * gain);
+            temp = std::max(static_cast<int32_t>(INT16_MIN), std::min(temp, static_cast<int32_t>(INT16_MAX)));
+            samples[i] = static_cast<int16_t>(temp);
+        }
+    }
+
+    void AudioGain::applyScalar(int16_t* samples, size_t count, float from, float step) {
+        for (size_t i = 0; i < count; ++i) {
+            float value = samples[i] * (from + step * static_cast<float>(i));
+            value = std::max(SAMPLE_MIN, std::min(value, SAMPLE_MAX));
+            samples[i] = static_cast<int16_t>(value);
+        }
+    }
+
+#if defined(MEDIA_GAIN_X86)
+    // The gain is recomputed from the sample index on every block, so the ramp does not
+    // accumulate rounding over long buffers. Values are clamped as floats because the
+    // truncating conversion turns overflow into INT32_MIN, the pack then narrows with
+    // saturation.
+    MEDIA_TARGET_SSE2
+    void AudioGain::applySSE2(int16_t* samples, size_t count, float from, float step) {
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 stepv = _mm_set1_ps(step);
+        const __m128 fromv = _mm_set1_ps(from);
+        const __m128 minv = _mm_set1_ps(SAMPLE_MIN);
+        const __m128 maxv = _mm_set1_ps(SAMPLE_MAX);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+            __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(input, input), 16);
+            __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(input, input), 16);
+
+            __m128 index = _mm_add_ps(_mm_set1_ps(static_cast<float>(i)), lanes);
+            __m128 gainLo = _mm_add_ps(fromv, _mm_mul_ps(stepv, index));
+            __m128 gainHi = _mm_add_ps(gainLo, _mm_mul_ps(stepv, _mm_set1_ps(4.0f)));
+
+            __m128 valueLo = _mm_mul_ps(_mm_cvtepi32_ps(lo), gainLo);
+            __m128 valueHi = _mm_mul_ps(_mm_cvtepi32_ps(hi), gainHi);
+            valueLo = _mm_max_ps(minv, _mm_min_ps(valueLo, maxv));
+            valueHi = _mm_max_ps(minv, _mm_min_ps(valueHi, maxv));
+
+            __m128i output = _mm_packs_epi32(_mm_cvttps_epi32(valueLo), _mm_cvttps_epi32(valueHi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(samples + i), output);
+        }
+
+        applyScalar(samples + i, count - i, from + step * static_cast<float>(i), step);
+    }
+
+    // cvtepi16 widens each half on its own, so the pack result only needs its two middle
+    // 64-bit lanes swapped back into order.
+    MEDIA_TARGET_AVX2
+    void AudioGain::applyAVX2(int16_t* samples, size_t count, float from, float step) {
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 stepv = _mm256_set1_ps(step);
+        const __m256 fromv = _mm256_set1_ps(from);
+        const __m256 minv = _mm256_set1_ps(SAMPLE_MIN);
+        const __m256 maxv = _mm256_set1_ps(SAMPLE_MAX);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)));
+            __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i + 8)));
+
+            __m256 index = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), lanes);
+            __m256 gainLo = _mm256_add_ps(fromv, _mm256_mul_ps(stepv, index));
+            __m256 gainHi = _mm256_add_ps(gainLo, _mm256_mul_ps(stepv, _mm256_set1_ps(8.0f)));
+
+            __m256 valueLo = _mm256_mul_ps(_mm256_cvtepi32_ps(lo), gainLo);
+            __m256 valueHi = _mm256_mul_ps(_mm256_cvtepi32_ps(hi), gainHi);
+            valueLo = _mm256_max_ps(minv, _mm256_min_ps(valueLo, maxv));
+            valueHi = _mm256_max_ps(minv, _mm256_min_ps(valueHi, maxv));
+
+            __m256i output = _mm256_packs_epi32(_mm256_cvttps_epi32(valueLo), _mm256_cvttps_epi32(valueHi));
+            output = _mm256_permute4x64_epi64(output, 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(samples + i), output);
+        }
+
+        applyScalar(samples + i, count - i, from + step * static_cast<float>(i), step);
+    }
+
+    // AVX2 also needs the OS to save the YMM registers, which the compiler builtin checks
+    // but cpuid alone does not.
+    bool AudioGain::cpuHasAVX2() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+} // namespace media
\ No newline at end of file
@@ -1,51 +1,76 @@
 #include "AudioPlayThread.h"
 
-AudioPlayThread::AudioPlayThread(QObject* parent, std::shared_ptr<MediaBuffer> buffer)
+AudioPlayThread::AudioPlayThread(QObject* parent, int samplerate)
     : QThread(parent)
-    , buffer_(buffer)
     , filter_(nullptr)
     , SDLAudioStream_(nullptr)
     , SDLAudioBuffer_(nullptr)
     , SDLAudioBufferSize_(0)
+    , renderBuffer_(nullptr)
+    , renderFrame_(nullptr)
+    , targetBytes_(0)
+    , bytesPerSecond_(0)
+    , frameBytes_(0)
     , initError_("")
+    , bindError_("")
+    , samplerate_(samplerate)
     , speed_(1.0f)
-    , volume_(0.7f)
+    , gain_(0.7f)
+    , serial_(0)
+    , ended_(false)
     , inited_(false)
-    , flush_(false)
+    , bound_(false)
     , paused_(false)
     , running_(false)
     , started_(false)
+    , firstFrame_(false)
+    , clockPending_(false)
+    , volume_(0.7f)
+    , item_(0)
+    , underruns_(0)
     , currentTime_(0.0) {
 
     do {
-        if (!buffer_) {
-            initError_ = "Media buffer is NULL";
-            break;
-        }
-
         if (!SDL_Init(SDL_INIT_AUDIO)) {
             initError_ = QString("SDL init audio failed: %1").arg(SDL_GetError());
             break;
         }
 
-        int samplerate = MCTX()->mediaInput()->audioParams().samplerate;
         int channels = MediaContext::TARGET_CHANNEL_LAYOUT.nb_channels;
 
-        if (samplerate <= 0 || channels <= 0) {
+        if (samplerate_ <= 0 || channels <= 0) {
             initError_ = "Invalid samplerate or channels";
             break;
         }
 
-        SDLAudioBufferSize_ = samplerate * 2 * channels * sizeof(int16_t);
+        frameBytes_ = channels * sizeof(int16_t);
+        bytesPerSecond_ = samplerate_ * frameBytes_;
+        targetBytes_ = static_cast<size_t>(bytesPerSecond_) * TARGET_LATENCY_MS / 1000;
+
+        SDLAudioBufferSize_ = bytesPerSecond_ * 2;
         SDLAudioBuffer_ = static_cast<uint8_t*>(av_malloc(SDLAudioBufferSize_));
         if (!SDLAudioBuffer_) {
             initError_ = "Malloc SDL audio buffer failed";
             break;
         }
 
+        renderBuffer_ = static_cast<uint8_t*>(av_malloc(SDLAudioBufferSize_));
+        if (!renderBuffer_) {
+            initError_ = "Malloc audio render buffer failed";
+            break;
+        }
+
+        renderFrame_ = av_frame_alloc();
+        if (!renderFrame_) {
+            initError_ = "Alloc audio render frame failed";
+            break;
+        }
+
+        ring_.reserve(bytesPerSecond_);
+
         SDL_AudioSpec spec;
         SDL_zero(spec);
-        spec.freq = samplerate;
+        spec.freq = samplerate_;
         spec.format = SDL_AUDIO_S16;
         spec.channels = static_cast<uint8_t>(channels);
 
@@ -58,35 +83,122 @@ AudioPlayThread::AudioPlayThread(QObject* parent, std::shared_ptr<MediaBuffer> b
             break;
         }
 
-        filter_ = std::make_unique<media::TempoFilter>();
-        int ret = filter_->init(samplerate,
-                                { 1, samplerate },
-                                MediaContext::TARGET_CHANNEL_LAYOUT,
-                                MediaContext::TARGET_SAMPLE_FORMAT,
-                                qBound(1, QThread::idealThreadCount(), 4));
-        if (ret < 0 || !filter_->isInited()) {
-            initError_ = "Tempo filter init failed";
+        inited_.store(true);
+
+    } while (false);
+
+    if (!inited_.load()) {
+        cleanup();
+    }
+}
+
+AudioPlayThread::~AudioPlayThread() {
+    stop();
+    unbind();
+    cleanup();
+}
+
+// The device stays open at the samplerate given to the constructor, so the context must
+// have been opened with that output samplerate. The tempo filter is rebuilt to drop the
+// previous media's tail.
+bool AudioPlayThread::bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    unbind();
+
+    do {
+        if (!context) {
+            bindError_ = "Media context is NULL";
+            break;
+        }
+
+        if (!buffer) {
+            bindError_ = "Media buffer is NULL";
+            break;
+        }
+
+        if (context->outputSampleRate() != samplerate_) {
+            bindError_ = "Output samplerate does not match the audio device";
+            break;
+        }
+
+        float speed;
+        {
+            QMutexLocker locker(&mutex_);
+            speed = speed_;
+        }
+
+        auto filter = std::make_unique<media::TempoFilter>();
+        int ret = filter->init(samplerate_,
+                               { 1, samplerate_ },
+                               MediaContext::TARGET_CHANNEL_LAYOUT,
+                               MediaContext::TARGET_SAMPLE_FORMAT,
+                               qBound(1, QThread::idealThreadCount(), 4));
+        if (ret < 0 || !filter->isInited()) {
+            bindError_ = "Tempo filter init failed";
             break;
         }
 
-        ret = filter_->setTempo(speed_);
+        ret = filter->setTempo(speed);
         if (ret < 0) {
-            initError_ = "Tempo filter set tempo failed";
+            bindError_ = "Tempo filter set tempo failed";
             break;
         }
 
-        inited_.store(true);
+        QMutexLocker locker(&bindMutex_);
+        context_ = std::move(context);
+        buffer_ = std::move(buffer);
+        filter_ = std::move(filter);
+        gain_ = volume_.load();
+        serial_ = buffer_->serial();
+        ended_ = false;
+        item_.store(buffer_->id());
+        underruns_.store(0);
+        currentTime_.store(0.0);
+        firstFrame_.store(false);
+        if (clock_) {
+            clock_->reset();
+        }
+
+        bound_.store(true);
+        locker.unlock();
+        wakeRender();
+        return true;
 
     } while (false);
 
-    if (!inited_.load()) {
-        cleanup();
+    return false;
+}
+
+// Waits for the render thread to finish its frame and drops what is left in the ring. The
+// device stays paused until resume() after the next bind().
+void AudioPlayThread::unbind() {
+    QMutexLocker locker(&bindMutex_);
+    bound_.store(false);
+
+    {
+        QMutexLocker sourceLocker(&mutex_);
+        nextContext_.reset();
+        nextBuffer_.reset();
+    }
+
+    context_.reset();
+    buffer_.reset();
+
+    if (clock_) {
+        clock_->reset();
+    }
+
+    if (SDLAudioStream_) {
+        SDL_PauseAudioStreamDevice(SDLAudioStream_);
     }
+    flushRing();
 }
 
-AudioPlayThread::~AudioPlayThread() {
-    stop();
-    cleanup();
+QString AudioPlayThread::bindError() const {
+    return bindError_;
+}
+
+int AudioPlayThread::sampleRate() const {
+    return samplerate_;
 }
 
 void AudioPlayThread::start() {
@@ -95,6 +207,7 @@ void AudioPlayThread::start() {
     }
 
     if (!inited_.load()) {
+        started_.store(false);
         emit audioPlayError(initError_);
         return;
     }
@@ -108,9 +221,12 @@ void AudioPlayThread::stop() {
     }
 
     running_.store(false);
-    flush_.store(false);
     requestInterruption();
     paused_.store(false);
+    {
+        QMutexLocker locker(&stopMutex_);
+        stopWc_.wakeAll();
+    }
 
     if (!wait(3000)) {
         terminate();
@@ -120,20 +236,28 @@ void AudioPlayThread::stop() {
     started_.store(false);
 }
 
+// The render thread then freezes the published clock (resume() restarts it from now), so
+// the video side does not extrapolate the last sample across the pause.
 void AudioPlayThread::pause() {
     paused_.store(true);
 
     if (SDLAudioStream_) {
         SDL_PauseAudioStreamDevice(SDLAudioStream_);
     }
+
+    clockPending_.store(true);
+    wakeRender();
 }
 
 void AudioPlayThread::resume() {
     paused_.store(false);
 
-    if (SDLAudioStream_) {
+    if (SDLAudioStream_ && bound_.load()) {
         SDL_ResumeAudioStreamDevice(SDLAudioStream_);
     }
+
+    clockPending_.store(true);
+    wakeRender();
 }
 
 void AudioPlayThread::setSpeed(float speed) {
@@ -155,38 +279,60 @@ void AudioPlayThread::setSpeed(float speed) {
 
 void AudioPlayThread::setVolume(int volume) {
     volume = qBound(0, volume, 100);
-
-    {
-        QMutexLocker locker(&mutex_);
-        volume_ = volume / 100.0f;
-    }
-
-    if (volume_ < 0.001f && SDLAudioStream_) {
-        SDL_ClearAudioStream(SDLAudioStream_);
-    }
+    volume_.store(volume / 100.0f);
 }
 
 double AudioPlayThread::getCurrentTime() const {
     return currentTime_.load();
 }
 
-void AudioPlayThread::onFlushStream() {
-    flush_.store(true);
+// The next item must be opened with this thread's output samplerate. Playback moves over
+// to it right after the current item's end of stream, without touching the audio device.
+void AudioPlayThread::setNextSource(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    QMutexLocker locker(&mutex_);
+    nextContext_ = std::move(context);
+    nextBuffer_ = std::move(buffer);
+}
 
-    if (SDLAudioStream_) {
-        SDL_ClearAudioStream(SDLAudioStream_);
-    }
+quint64 AudioPlayThread::underruns() const {
+    return underruns_.load();
+}
+
+void AudioPlayThread::setAudioClock(std::shared_ptr<media::AudioClock> clock) {
+    clock_ = std::move(clock);
 }
 
 void AudioPlayThread::run() {
     running_.store(true);
 
-    if (SDLAudioStream_) {
+    if (SDLAudioStream_ && bound_.load() && !paused_.load()) {
         SDL_ResumeAudioStreamDevice(SDLAudioStream_);
     }
 
     while (running_.load() && !isInterruptionRequested()) {
-        msleep(50);
+        if (clockPending_.exchange(false)) {
+            QMutexLocker locker(&bindMutex_);
+            if (bound_.load()) {
+                holdClock(paused_.load());
+            }
+        }
+
+        if (bound_.load() && !paused_.load() && ring_.size() < targetBytes_ && processFrame()) {
+            continue;
+        }
+
+        // Idle until bind(), resume() or stop() wake it, only playback polls the ring.
+        QMutexLocker locker(&stopMutex_);
+        if (!running_.load() || isInterruptionRequested() || clockPending_.load()) {
+            continue;
+        }
+
+        if (bound_.load() && !paused_.load()) {
+            stopWc_.wait(&stopMutex_, FILL_INTERVAL_MS);
+        }
+        else {
+            stopWc_.wait(&stopMutex_);
+        }
     }
 
     if (SDLAudioStream_) {
@@ -196,22 +342,28 @@ void AudioPlayThread::run() {
     running_.store(false);
 }
 
-int AudioPlayThread::processFrame(uint8_t* buffer, int size) {
-    if (!buffer || !filter_ || !buffer_ || size <= 0) {
-        return 0;
+// Runs on the render thread: one frame through the tempo filter and the volume into the
+// ring. Everything that may lock or allocate stays here, out of the audio callback. False
+// when no frame was ready.
+bool AudioPlayThread::processFrame() {
+    QMutexLocker locker(&bindMutex_);
+    if (!bound_.load() || !filter_ || !buffer_ || !renderBuffer_ || !renderFrame_) {
+        return false;
     }
 
-    AVFrame* srcFrame = reinterpret_cast<AVFrame*>(buffer_->dequeue<media::AUDIO, media::DECODING>());
+    AVFrame* srcFrame = nextFrame();
     if (!srcFrame) {
-        return 0;
+        return false;
     }
 
-    AVFrame* dstFrame = av_frame_alloc();
-    if (!dstFrame) {
-        av_frame_free(&srcFrame);
-        return 0;
+    int64_t serial = media::itemSerial(srcFrame);
+    if (serial != serial_) {
+        serial_ = serial;
+        ended_ = false;
+        flushRing();
     }
 
+    AVFrame* dstFrame = renderFrame_;
     double pts = srcFrame->pts * av_q2d(srcFrame->time_base);
     double duration = srcFrame->duration * av_q2d(srcFrame->time_base);
 
@@ -232,56 +384,139 @@ int AudioPlayThread::processFrame(uint8_t* buffer, int size) {
                                              dstFrame->nb_samples,
                                              static_cast<AVSampleFormat>(dstFrame->format),
                                              1);
-        if (dstSize <= 0 || dstSize > size) {
+        if (dstSize <= 0 || dstSize > static_cast<int>(SDLAudioBufferSize_)) {
+            dstSize = 0;
             break;
         }
 
-        memcpy(buffer, dstFrame->data[0], dstSize);
-        processVolume(buffer, dstSize);
+        memcpy(renderBuffer_, dstFrame->data[0], dstSize);
+        processVolume(renderBuffer_, dstSize);
 
     } while (false);
 
     av_frame_free(&srcFrame);
-    av_frame_free(&dstFrame);
+    av_frame_unref(dstFrame);
 
     currentTime_.store(pts);
-    emit updateAudioClock(pts, duration);
+    publishClock(pts, duration);
+
+    if (dstSize > 0) {
+        ring_.write(renderBuffer_, dstSize);
+    }
+
+    if (!firstFrame_.exchange(true)) {
+        emit firstFrame();
+    }
 
-    return dstSize;
+    return true;
 }
 
-int AudioPlayThread::processVolume(uint8_t* buffer, int size) {
-    if (!buffer || size <= 0) {
-        return 0;
+// The new samples only start playing after everything still in the ring and queued in the
+// SDL stream, so what is heard right now lies that far, scaled by the tempo, behind pts.
+void AudioPlayThread::publishClock(double pts, double duration) {
+    if (!clock_) {
+        return;
     }
 
-    float volume;
+    float speed;
     {
         QMutexLocker locker(&mutex_);
-        volume = volume_;
+        speed = speed_;
     }
 
-    if (volume < 0.001f) {
-        memset(buffer, 0, size);
-        return size;
+    const int queued = SDLAudioStream_ ? std::max(0, SDL_GetAudioStreamQueued(SDLAudioStream_)) : 0;
+    const size_t pending = ring_.size() + static_cast<size_t>(queued);
+    const double latency = bytesPerSecond_ > 0 ? static_cast<double>(pending) / bytesPerSecond_ : 0.0;
+
+    clock_->publish({ pts - latency * speed, duration, speed, media::AudioClock::now(), item_.load(), serial_ });
+}
+
+// Moves the last sample to now, frozen with a speed of 0 while paused. Runs on the render
+// thread with bindMutex_ held, which keeps it the clock's only writer.
+void AudioPlayThread::holdClock(bool paused) {
+    media::AudioClock::Sample sample;
+    if (!clock_ || !clock_->read(sample)) {
+        return;
     }
 
-    if (qAbs(volume - 1.0f) < 0.001f) {
-        return size;
+    const int64_t current = media::AudioClock::now();
+    sample.pts += (current - sample.stamp) / 1000000.0 * sample.speed;
+    sample.stamp = current;
+
+    if (paused) {
+        sample.speed = 0.0;
+    }
+    else {
+        QMutexLocker locker(&mutex_);
+        sample.speed = speed_;
     }
 
-    int16_t* samples = reinterpret_cast<int16_t*>(buffer);
-    int total = size / sizeof(int16_t);
+    clock_->publish(sample);
+}
 
-    for (int i = 0; i < total; i += 256) {
-        int blockEnd = qMin(i + 256, total);
-        for (int j = i; j < blockEnd; ++j) {
-            int32_t temp = static_cast<int32_t>(samples[j] * volume);
-            temp = qBound(static_cast<int32_t>(INT16_MIN), temp, static_cast<int32_t>(INT16_MAX));
-            samples[j] = static_cast<int16_t>(temp);
+void AudioPlayThread::wakeRender() {
+    QMutexLocker locker(&stopMutex_);
+    stopWc_.wakeAll();
+}
+
+AVFrame* AudioPlayThread::nextFrame() {
+    if (ended_) {
+        switchSource();
+    }
+
+    AVFrame* frame = buffer_->dequeue<media::AUDIO, media::DECODING>();
+    while (frame) {
+        if (media::itemSerial(frame) < buffer_->serial()) {
+            av_frame_free(&frame);
+        }
+        else if (media::isEndOfStream(frame)) {
+            av_frame_free(&frame);
+            ended_ = true;
+            if (!switchSource()) {
+                return nullptr;
+            }
+        }
+        else {
+            break;
+        }
+        frame = buffer_->dequeue<media::AUDIO, media::DECODING>();
+    }
+
+    return frame;
+}
+
+// Samples still in the ring, the SDL stream and the tempo filter belong to the previous item
+// and are played out, that is what makes the transition gapless.
+bool AudioPlayThread::switchSource() {
+    {
+        QMutexLocker locker(&mutex_);
+        if (!nextBuffer_) {
+            return false;
         }
+
+        context_ = std::move(nextContext_);
+        buffer_ = std::move(nextBuffer_);
     }
 
+    serial_ = buffer_->serial();
+    ended_ = false;
+    item_.store(buffer_->id());
+
+    emit sourceSwitched();
+    return true;
+}
+
+// The gain ramps from the previous buffer's volume over this buffer, a slider move or a
+// mute fades in one frame instead of stepping.
+int AudioPlayThread::processVolume(uint8_t* buffer, int size) {
+    if (!buffer || size <= 0) {
+        return 0;
+    }
+
+    const float volume = volume_.load(std::memory_order_relaxed);
+    media::AudioGain::apply(reinterpret_cast<int16_t*>(buffer), size / sizeof(int16_t), gain_, volume);
+    gain_ = volume;
+
     return size;
 }
 
@@ -292,27 +527,37 @@ void SDLCALL AudioPlayThread::audioStreamCallback(void* userdata, SDL_AudioStrea
 
     AudioPlayThread* pthis = static_cast<AudioPlayThread*>(userdata);
 
-    if (!pthis->running_.load() || pthis->paused_.load()) {
-        SDL_Delay(1);
+    if (!pthis->running_.load() || pthis->paused_.load() || additional <= 0) {
         return;
     }
 
-    if (pthis->flush_.exchange(false)) {
-        SDL_ClearAudioStream(stream);
+    // Only a flush holds the lock, its samples are being dropped anyway.
+    std::unique_lock<std::mutex> locker(pthis->ringMutex_, std::try_to_lock);
+    if (!locker.owns_lock()) {
         return;
     }
 
-    if (additional <= 0) {
-        SDL_Delay(1);
-        return;
+    size_t size = std::min(static_cast<size_t>(additional), pthis->SDLAudioBufferSize_);
+    size -= size % pthis->frameBytes_;
+
+    size_t read = pthis->ring_.read(pthis->SDLAudioBuffer_, size);
+    if (read < size && pthis->bound_.load() && pthis->firstFrame_.load() && !pthis->ended_.load()) {
+        pthis->underruns_.fetch_add(1);
     }
 
-    int size = pthis->processFrame(pthis->SDLAudioBuffer_, pthis->SDLAudioBufferSize_);
-    if (size <= 0) {
-        return;
+    if (read > 0) {
+        SDL_PutAudioStreamData(stream, pthis->SDLAudioBuffer_, static_cast<int>(read));
     }
+}
 
-    SDL_PutAudioStreamData(stream, pthis->SDLAudioBuffer_, size);
+// Callers keep the render thread out, the callback is kept out by ringMutex_.
+void AudioPlayThread::flushRing() {
+    std::lock_guard<std::mutex> locker(ringMutex_);
+    ring_.clear();
+
+    if (SDLAudioStream_) {
+        SDL_ClearAudioStream(SDLAudioStream_);
+    }
 }
 
 void AudioPlayThread::cleanup() {
@@ -326,6 +571,15 @@ void AudioPlayThread::cleanup() {
         SDLAudioBuffer_ = nullptr;
     }
 
+    if (renderBuffer_) {
+        av_freep(&renderBuffer_);
+        renderBuffer_ = nullptr;
+    }
+
+    if (renderFrame_) {
+        av_frame_free(&renderFrame_);
+    }
+
     if (SDL_WasInit(SDL_INIT_AUDIO)) {
         SDL_QuitSubSystem(SDL_INIT_AUDIO);
     }
@@ -124,7 +124,7 @@ void ControlBar::setupUi() {
 
 void ControlBar::setupProgressSlider() {
     progressSlider = new CustomSlider(this);
-    progressSlider->setRange(0, 100);
+    progressSlider->setRange(0, PROGRESS_MAX);
     progressSlider->setValue(0);
     progressSlider->setFixedHeight(24);
     progressSlider->setHandleSize(17);
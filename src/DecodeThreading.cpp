@@ -0,0 +1,177 @@
+#include "DecodeThreading.h"
+
+namespace media {
+
+    std::mutex DecodeThreading::mutex_;
+    std::map<uint64_t, DecodeThreading::Tuning> DecodeThreading::tunings_;
+    std::atomic<int> DecodeThreading::active_(0);
+
+    void CodecContextDeleter::operator()(AVCodecContext* ctx) const {
+        if (!ctx) {
+            return;
+        }
+
+        if (avcodec_is_open(ctx)) {
+            DecodeThreading::decoderClosed();
+        }
+        avcodec_free_context(&ctx);
+    }
+
+    bool DecodeThreading::parse(const std::string& text, DecodeThreadPolicy& policy) {
+        std::string mode = text;
+        int threads = 0;
+
+        size_t colon = text.find(':');
+        if (colon != std::string::npos) {
+            mode = text.substr(0, colon);
+            threads = std::atoi(text.c_str() + colon + 1);
+            if (threads <= 0) {
+                return false;
+            }
+        }
+
+        if (mode == "auto") {
+            policy.mode = DecodeThreadMode::Auto;
+        }
+        else if (mode == "frame") {
+            policy.mode = DecodeThreadMode::Frame;
+        }
+        else if (mode == "slice") {
+            policy.mode = DecodeThreadMode::Slice;
+        }
+        else if (colon == std::string::npos && std::atoi(mode.c_str()) > 0) {
+            policy.mode = DecodeThreadMode::Fixed;
+            threads = std::atoi(mode.c_str());
+        }
+        else {
+            return false;
+        }
+
+        policy.threads = threads;
+        return true;
+    }
+
+    DecodeThreadSetup DecodeThreading::choose(const DecodeThreadPolicy& policy, const AVCodec* codec, int width, int height) {
+        const int caps = codec ? codec->capabilities : 0;
+        const bool frameCap = (caps & AV_CODEC_CAP_FRAME_THREADS) != 0;
+        const bool sliceCap = (caps & AV_CODEC_CAP_SLICE_THREADS) != 0;
+
+        if (policy.mode == DecodeThreadMode::Fixed) {
+            return { std::max(1, policy.threads), FF_THREAD_FRAME | FF_THREAD_SLICE };
+        }
+
+        const int limit = maxThreads(policy);
+        int count = 0;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            auto it = tunings_.find(tuningKey(codec ? codec->id : 0, width, height));
+            if (it != tunings_.end()) {
+                count = it->second.threads;
+            }
+        }
+
+        if (count <= 0) {
+            const int64_t pixels = static_cast<int64_t>(width) * height;
+            if (pixels <= 640 * 360) {
+                count = 1;
+            }
+            else if (pixels <= 1280 * 720) {
+                count = 2;
+            }
+            else if (pixels <= 1920 * 1080) {
+                count = 4;
+            }
+            else {
+                count = limit;
+            }
+
+            // The decoder being opened is not counted yet.
+            const int share = std::max(1, limit / (activeDecoders() + 1));
+            count = std::min(count, share);
+        }
+        count = std::max(1, std::min(count, limit));
+
+        int type = 0;
+        switch (policy.mode) {
+        case DecodeThreadMode::Frame:
+            type = FF_THREAD_FRAME;
+            break;
+        case DecodeThreadMode::Slice:
+            type = FF_THREAD_SLICE;
+            break;
+        default:
+            // Frame threading scales better but adds a frame of latency per thread, slice
+            // threading only helps streams encoded with several slices.
+            type = frameCap ? FF_THREAD_FRAME : (sliceCap ? FF_THREAD_SLICE : 0);
+            break;
+        }
+
+        return { type ? count : 1, type };
+    }
+
+    void DecodeThreading::apply(AVCodecContext* ctx, const DecodeThreadSetup& setup) {
+        if (!ctx) {
+            return;
+        }
+
+        ctx->thread_count = setup.count;
+        ctx->thread_type = setup.type;
+    }
+
+    int DecodeThreading::tune(const DecodeThreadPolicy& policy, const AVCodecContext* ctx, double decodeFps, double neededFps) {
+        if (!ctx || policy.mode == DecodeThreadMode::Fixed || decodeFps <= 0.0 || neededFps <= 0.0) {
+            return 0;
+        }
+
+        const int limit = maxThreads(policy);
+        const int threads = std::max(1, ctx->thread_count);
+        const uint64_t key = tuningKey(ctx->codec ? ctx->codec->id : 0, ctx->width, ctx->height);
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        Tuning& tuning = tunings_.emplace(key, Tuning{ threads, 1 }).first->second;
+
+        if (decodeFps < neededFps * HEADROOM) {
+            tuning.floor = std::max(tuning.floor, threads + 1);
+            tuning.threads = std::min(limit, std::max(tuning.floor, threads * 2));
+            return (ctx->active_thread_type && tuning.threads > threads) ? tuning.threads : 0;
+        }
+
+        if (decodeFps > neededFps * SURPLUS) {
+            tuning.threads = std::max(tuning.floor, threads / 2);
+        }
+        else {
+            tuning.threads = std::max(tuning.floor, threads);
+        }
+
+        return 0;
+    }
+
+    void DecodeThreading::decoderOpened() {
+        active_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void DecodeThreading::decoderClosed() {
+        active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    int DecodeThreading::activeDecoders() {
+        return std::max(0, active_.load(std::memory_order_relaxed));
+    }
+
+    int DecodeThreading::maxThreads(const DecodeThreadPolicy& policy) {
+        int cores = static_cast<int>(std::thread::hardware_concurrency());
+        if (cores <= 0) {
+            cores = 1;
+        }
+
+        return policy.threads > 0 ? std::min(policy.threads, cores) : cores;
+    }
+
+    // Resolution is bucketed by 16 pixel macroblocks so slightly different sizes share a tuning.
+    uint64_t DecodeThreading::tuningKey(int codecId, int width, int height) {
+        return (static_cast<uint64_t>(codecId) << 32) |
+               (static_cast<uint64_t>((width + 15) / 16 & 0xFFFF) << 16) |
+               static_cast<uint64_t>((height + 15) / 16 & 0xFFFF);
+    }
+
+} // namespace media
\ No newline at end of file
@@ -1,62 +1,146 @@
 #include "DemuxThread.h"
 
-DemuxThread::DemuxThread(QObject* parent, std::shared_ptr<MediaBuffer> buffer)
+DemuxThread::DemuxThread(QObject* parent)
     : QThread(parent)
-    , buffer_(buffer)
     , inputCtx_(nullptr)
     , pkt_(nullptr)
     , vsIndex_(-1)
     , asIndex_(-1)
     , initError_("")
-    , seekSeconds_(0)
+    , bindError_("")
+    , seekTarget_(0)
+    , seekRequest_(0)
+    , serial_(0)
+    , parked_(false)
     , inited_(false)
+    , bound_(false)
+    , interruptible_(false)
     , eof_(false)
     , seeking_(false)
+    , accurateSeek_(false)
     , running_(false)
     , started_(false) {
 
     do {
-        if (!buffer) {
-            initError_ = "Media buffer is NULL";
+        pkt_ = av_packet_alloc();
+        if (!pkt_) {
+            initError_ = "AVPacket alloc failed";
             break;
         }
 
-        inputCtx_ = MCTX()->mediaInput()->inputContext();
-        if (!inputCtx_) {
-            initError_ = "Input context is NULL";
+        inited_.store(true);
+
+    } while (0);
+
+    if (!inited_.load()) {
+        cleanup();
+    }
+}
+
+DemuxThread::~DemuxThread() {
+    stop();
+    unbind();
+    cleanup();
+}
+
+// The thread outlives its media: bind() attaches an opened context and buffer, unbind()
+// parks the run loop and releases them again, so a file switch never respawns the thread.
+bool DemuxThread::bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    unbind();
+
+    do {
+        if (!context) {
+            bindError_ = "Media context is NULL";
             break;
         }
 
-        if (MCTX()->mediaInput()->hasVideoStream()) {
-            vsIndex_ = MCTX()->mediaInput()->videoParams().index;
-        }
-        if (MCTX()->mediaInput()->hasAudioStream()) {
-            asIndex_ = MCTX()->mediaInput()->audioParams().index;
+        if (!buffer) {
+            bindError_ = "Media buffer is NULL";
+            break;
         }
 
-        if (vsIndex_ < 0 && asIndex_ < 0) {
-            initError_ = "Not found video and audio";
+        AVFormatContext* inputCtx = context->mediaInput()->inputContext();
+        if (!inputCtx) {
+            bindError_ = "Input context is NULL";
             break;
         }
 
-        pkt_ = av_packet_alloc();
-        if (!pkt_) {
-            initError_ = "AVPacket alloc failed";
+        int vsIndex = context->mediaInput()->hasVideoStream() ? context->mediaInput()->videoParams().index : -1;
+        int asIndex = context->mediaInput()->hasAudioStream() ? context->mediaInput()->audioParams().index : -1;
+        if (vsIndex < 0 && asIndex < 0) {
+            bindError_ = "Not found video and audio";
             break;
         }
 
-        inited_.store(true);
+        QMutexLocker locker(&bindMutex_);
+        context_ = std::move(context);
+        buffer_ = std::move(buffer);
+        inputCtx_ = inputCtx;
+        vsIndex_ = vsIndex;
+        asIndex_ = asIndex;
+        serial_ = buffer_->serial();
+        eof_.store(false);
+        seeking_.store(false);
+
+        // Lets a newer seek, unbind() or stop() abort a blocking read or seek, unless the
+        // input already installed its own callback.
+        if (!inputCtx_->interrupt_callback.callback) {
+            inputCtx_->interrupt_callback.callback = &DemuxThread::interruptCallback;
+            inputCtx_->interrupt_callback.opaque = this;
+            interruptible_.store(true);
+        }
+
+        bound_.store(true);
+        bindWc_.wakeAll();
+        return true;
 
     } while (0);
 
-    if (!inited_.load()) {
-        cleanup();
+    return false;
+}
+
+// Returns once the run loop is parked, the caller may release the media afterwards.
+void DemuxThread::unbind() {
+    bound_.store(false);
+    seeking_.store(false);
+    {
+        QMutexLocker locker(&eofMutex_);
+        eofWc_.wakeAll();
+    }
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
+
+    QMutexLocker locker(&bindMutex_);
+    while (isRunning() && running_.load() && !parked_) {
+        bindWc_.wait(&bindMutex_);
+    }
+
+    if (interruptible_.exchange(false) && inputCtx_) {
+        inputCtx_->interrupt_callback.callback = nullptr;
+        inputCtx_->interrupt_callback.opaque = nullptr;
+    }
+
+    {
+        QMutexLocker indexLocker(&mutex_);
+        index_.reset();
+    }
+
+    if (pkt_) {
+        av_packet_unref(pkt_);
     }
+
+    context_.reset();
+    buffer_.reset();
+    inputCtx_ = nullptr;
+    vsIndex_ = -1;
+    asIndex_ = -1;
+    eof_.store(false);
 }
 
-DemuxThread::~DemuxThread() {
-    stop();
-    cleanup();
+QString DemuxThread::bindError() const {
+    return bindError_;
 }
 
 void DemuxThread::start() {
@@ -65,6 +149,7 @@ void DemuxThread::start() {
     }
 
     if (!inited_.load()) {
+        started_.store(false);
         emit demuxError(initError_);
         return;
     }
@@ -86,6 +171,14 @@ void DemuxThread::stop() {
         QMutexLocker locker(&eofMutex_);
         eofWc_.wakeAll();
     }
+    {
+        QMutexLocker locker(&bindMutex_);
+        bindWc_.wakeAll();
+    }
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
 
     if (!wait(3000)) {
         terminate();
@@ -95,14 +188,16 @@ void DemuxThread::stop() {
     started_.store(false);
 }
 
-void DemuxThread::seek(int64_t seconds) {
-    if (!running_.load()) {
-        return;
+qint64 DemuxThread::seek(int64_t timestamp) {
+    if (!running_.load() || !bound_.load()) {
+        return -1;
     }
 
+    qint64 request = 0;
     {
         QMutexLocker locker(&mutex_);
-        seekSeconds_ = seconds;
+        seekTarget_ = timestamp;
+        request = ++seekRequest_;
     }
     seeking_.store(true);
 
@@ -111,16 +206,38 @@ void DemuxThread::seek(int64_t seconds) {
         QMutexLocker locker(&eofMutex_);
         eofWc_.wakeAll();
     }
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
+
+    return request;
+}
+
+// In accurate mode the decoders drop everything before the target instead of playing
+// from the keyframe av_seek_frame lands on.
+void DemuxThread::setAccurateSeek(bool accurate) {
+    accurateSeek_.store(accurate);
+}
+
+void DemuxThread::setKeyframeIndex(std::shared_ptr<const media::KeyframeIndex> index) {
+    QMutexLocker locker(&mutex_);
+    index_ = std::move(index);
 }
 
 void DemuxThread::run() {
     running_.store(true);
 
     while (running_.load() && !isInterruptionRequested()) {
+        if (!bound_.load()) {
+            park();
+            continue;
+        }
+
         if (eof_.load()) {
             QMutexLocker locker(&eofMutex_);
-            if (running_.load() && !seeking_.load()) {
-                eofWc_.wait(&eofMutex_, 50);
+            if (running_.load() && bound_.load() && !seeking_.load() && eof_.load()) {
+                eofWc_.wait(&eofMutex_);
             }
             continue;
         }
@@ -135,14 +252,18 @@ void DemuxThread::run() {
 
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
+                processEndOfStream();
                 eof_.store(true);
             }
             else if (ret == AVERROR(EAGAIN)) {
                 msleep(1);
             }
+            else if (ret == AVERROR_EXIT && (seeking_.load() || !running_.load() || !bound_.load())) {
+                continue;
+            }
             else {
                 emit demuxError("Demux thread read frame failed");
-                break;
+                bound_.store(false);
             }
             continue;
         }
@@ -162,23 +283,56 @@ void DemuxThread::processPacket() {
         return;
     }
 
-    AVPacket* packet = av_packet_alloc();
+    AVPacket* packet = buffer_->acquirePacket();
     if (!packet) {
         return;
     }
 
+    bool video = (pkt_->stream_index == vsIndex_);
     av_packet_move_ref(packet, pkt_);
+    packet->time_base = inputCtx_->streams[packet->stream_index]->time_base;
+    media::setItemSerial(packet, serial_);
 
-    bool ok = false;
-    if (packet->stream_index == vsIndex_) {
-        ok = buffer_->enqueue<AVPacket, media::VIDEO, media::DEMUXING>(packet);
+    enqueuePacket(packet, video);
+}
+
+// Tells the decoders to drain: without it the last frames of each stream stay inside the
+// codec and a following item could never start until the time based end detection fires.
+void DemuxThread::processEndOfStream() {
+    if (!buffer_) {
+        return;
+    }
+
+    const int indexes[] = { vsIndex_, asIndex_ };
+    for (int index : indexes) {
+        if (index < 0) {
+            continue;
+        }
+
+        AVPacket* packet = buffer_->acquirePacket();
+        if (!packet) {
+            continue;
+        }
+
+        media::setEndOfStream(packet);
+        media::setItemSerial(packet, serial_);
+        enqueuePacket(packet, index == vsIndex_);
     }
-    else if (packet->stream_index == asIndex_) {
-        ok = buffer_->enqueue<AVPacket, media::AUDIO, media::DEMUXING>(packet);
+}
+
+void DemuxThread::enqueuePacket(AVPacket* packet, bool video) {
+    bool ok = false;
+    while (!ok && running_.load() && bound_.load() && !seeking_.load() && !isInterruptionRequested()) {
+        if (video) {
+            ok = buffer_->enqueue<media::VIDEO, media::DEMUXING>(packet, media::MediaWait_Infinite);
+        }
+        else {
+            ok = buffer_->enqueue<media::AUDIO, media::DEMUXING>(packet, media::MediaWait_Infinite);
+        }
     }
 
     if (!ok) {
-        av_packet_free(&packet);
+        buffer_->releasePacket(packet);
     }
 }
 
@@ -187,26 +341,80 @@ void DemuxThread::performSeek() {
         return;
     }
 
-    int64_t pos;
-    {
-        QMutexLocker locker(&mutex_);
-        pos = seekSeconds_;
-    }
+    int64_t timestamp = 0;
+    qint64 request = 0;
+    std::shared_ptr<const media::KeyframeIndex> index;
+    int ret = 0;
+
+    // Only the latest target matters: requests that arrive while av_seek_frame runs
+    // interrupt it and are served before any packet is read.
+    do {
+        {
+            QMutexLocker locker(&mutex_);
+            timestamp = seekTarget_;
+            request = seekRequest_;
+            index = index_;
+        }
 
-    buffer_->lock();
-    buffer_->clear();
+        // The decoders compare the target against frame pts, so it goes on the stream timeline too.
+        const int64_t target = streamTimestamp(timestamp);
+        serial_ = buffer_->nextSerial(accurateSeek_.load() ? target : AV_NOPTS_VALUE);
 
-    int64_t timestamp = pos * AV_TIME_BASE;
-    int ret = av_seek_frame(inputCtx_, -1, timestamp, AVSEEK_FLAG_BACKWARD);
+        ret = seekFile(target, index.get());
+    } while (running_.load() && bound_.load() && seeking_.exchange(false));
+
+    if (!running_.load() || !bound_.load()) {
+        return;
+    }
 
     if (ret < 0) {
         emit demuxError("Demux thread seek failed");
+        return;
+    }
+
+    emit seekFinished(request);
+}
+
+// Seek targets count from the start of the media, the index and av_seek_frame work on the
+// stream timeline, which starts at the container's start_time.
+int64_t DemuxThread::streamTimestamp(int64_t timestamp) const {
+    const int64_t start = inputCtx_->start_time;
+    return start != AV_NOPTS_VALUE ? timestamp + start : timestamp;
+}
+
+// Streams with timestamp discontinuities (TS/PS) have no index of their own, there the
+// keyframe index lets the demuxer jump straight to the byte offset of the keyframe.
+// Containers like MKV/MP4 seek exactly by timestamp through their own index.
+int DemuxThread::seekFile(int64_t timestamp, const media::KeyframeIndex* index) {
+    const int flags = inputCtx_->iformat->flags;
+    media::KeyframeEntry entry;
+    if (index && (flags & AVFMT_TS_DISCONT) && !(flags & AVFMT_NO_BYTE_SEEK) && index->lookup(timestamp, &entry)) {
+        int ret = av_seek_frame(inputCtx_, -1, entry.pos, AVSEEK_FLAG_BYTE);
+        if (ret >= 0 || ret == AVERROR_EXIT) {
+            return ret;
+        }
     }
-    else {
-        emit flushRequest();
+
+    return av_seek_frame(inputCtx_, -1, timestamp, AVSEEK_FLAG_BACKWARD);
+}
+
+void DemuxThread::park() {
+    QMutexLocker locker(&bindMutex_);
+    parked_ = true;
+    bindWc_.wakeAll();
+    while (running_.load() && !bound_.load()) {
+        bindWc_.wait(&bindMutex_);
+    }
+    parked_ = false;
+}
+
+int DemuxThread::interruptCallback(void* opaque) {
+    DemuxThread* pthis = static_cast<DemuxThread*>(opaque);
+    if (!pthis) {
+        return 0;
     }
 
-    buffer_->unlock();
+    return (pthis->seeking_.load() || !pthis->running_.load() || !pthis->bound_.load()) ? 1 : 0;
 }
 
 void DemuxThread::cleanup() {
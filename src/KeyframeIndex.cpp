@@ -0,0 +1,228 @@
+#include "KeyframeIndex.h"
+
+namespace media {
+
+    static_assert(sizeof(KeyframeEntry) == 16, "KeyframeEntry must stay packed");
+
+    KeyframeIndex::KeyframeIndex()
+        : file_(nullptr)
+        , entries_(nullptr)
+        , count_(0) {
+    }
+
+    KeyframeIndex::~KeyframeIndex() {
+        close();
+    }
+
+    QString KeyframeIndex::cachePath(const QString& filePath) {
+        QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/keyframes";
+        QByteArray key = QCryptographicHash::hash(QFileInfo(filePath).absoluteFilePath().toUtf8(),
+                                                  QCryptographicHash::Sha1).toHex();
+        return QDir(dir).filePath(QString::fromLatin1(key) + ".kfi");
+    }
+
+    int KeyframeIndex::open(const QString& filePath, int streamIndex) {
+        close();
+
+        QFileInfo info(filePath);
+        if (!info.exists() || !info.isFile()) {
+            return AVERROR(ENOENT);
+        }
+
+        auto file = std::make_unique<QFile>(cachePath(filePath));
+        if (!file->open(QFile::ReadOnly)) {
+            return AVERROR(ENOENT);
+        }
+
+        const qint64 fileSize = file->size();
+        if (fileSize < static_cast<qint64>(sizeof(Header))) {
+            return AVERROR_INVALIDDATA;
+        }
+
+        uchar* data = file->map(0, fileSize);
+        if (!data) {
+            return AVERROR(ENOMEM);
+        }
+
+        Header header;
+        std::memcpy(&header, data, sizeof(Header));
+
+        const qint64 expected = static_cast<qint64>(sizeof(Header) + header.count * sizeof(KeyframeEntry));
+        if (std::memcmp(header.magic, "VPKI", 4) != 0 ||
+            header.version != VERSION ||
+            header.fileSize != info.size() ||
+            header.mtime != info.lastModified().toMSecsSinceEpoch() ||
+            header.streamIndex != streamIndex ||
+            header.count == 0 ||
+            expected != fileSize) {
+            file->unmap(data);
+            return AVERROR_INVALIDDATA;
+        }
+
+        file_ = std::move(file);
+        entries_ = reinterpret_cast<const KeyframeEntry*>(data + sizeof(Header));
+        count_ = header.count;
+
+        return 0;
+    }
+
+    int KeyframeIndex::build(const QString& filePath, int streamIndex, const std::atomic<bool>& abort) {
+        close();
+
+        QFileInfo info(filePath);
+        if (!info.exists() || !info.isFile() || streamIndex < 0) {
+            return AVERROR(EINVAL);
+        }
+
+        AVFormatContext* ctx = avformat_alloc_context();
+        if (!ctx) {
+            return AVERROR(ENOMEM);
+        }
+
+        ctx->interrupt_callback.callback = &KeyframeIndex::interruptCallback;
+        ctx->interrupt_callback.opaque = const_cast<std::atomic<bool>*>(&abort);
+
+        QByteArray url = filePath.toUtf8();
+        int ret = avformat_open_input(&ctx, url.constData(), nullptr, nullptr);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = avformat_find_stream_info(ctx, nullptr);
+        if (ret < 0 || streamIndex >= static_cast<int>(ctx->nb_streams)) {
+            avformat_close_input(&ctx);
+            return ret < 0 ? ret : AVERROR_STREAM_NOT_FOUND;
+        }
+
+        for (unsigned i = 0; i < ctx->nb_streams; ++i) {
+            ctx->streams[i]->discard = (static_cast<int>(i) == streamIndex) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+        }
+
+        const AVRational timeBase = ctx->streams[streamIndex]->time_base;
+        std::vector<KeyframeEntry> entries;
+        int64_t lastPts = AV_NOPTS_VALUE;
+        int64_t lastGap = 0;
+        int64_t offset = 0;
+
+        AVPacket* pkt = av_packet_alloc();
+        if (!pkt) {
+            avformat_close_input(&ctx);
+            return AVERROR(ENOMEM);
+        }
+
+        while (!abort.load()) {
+            ret = av_read_frame(ctx, pkt);
+            if (ret < 0) {
+                break;
+            }
+
+            int64_t pts = (pkt->pts != AV_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+            if (pkt->stream_index == streamIndex && (pkt->flags & AV_PKT_FLAG_KEY) &&
+                pkt->pos >= 0 && pts != AV_NOPTS_VALUE) {
+                pts = av_rescale_q(pts, timeBase, AV_TIME_BASE_Q);
+
+                // After a discontinuity the new segment is shifted to continue one keyframe
+                // interval after the previous one, so the table stays sorted in file order.
+                if (lastPts != AV_NOPTS_VALUE) {
+                    const int64_t gap = pts - lastPts;
+                    if (gap <= 0 || gap > MAX_KEYFRAME_GAP) {
+                        offset += lastPts + std::max<int64_t>(lastGap, 1) - pts;
+                    }
+                    else {
+                        lastGap = gap;
+                    }
+                }
+                lastPts = pts;
+
+                if (entries.empty() || pts + offset > entries.back().pts) {
+                    entries.push_back({ pts + offset, pkt->pos });
+                }
+            }
+
+            av_packet_unref(pkt);
+        }
+
+        av_packet_free(&pkt);
+        avformat_close_input(&ctx);
+
+        if (abort.load()) {
+            return AVERROR_EXIT;
+        }
+
+        if (ret != AVERROR_EOF) {
+            return ret;
+        }
+
+        if (entries.empty()) {
+            return AVERROR_INVALIDDATA;
+        }
+
+        Header header;
+        std::memcpy(header.magic, "VPKI", 4);
+        header.version = VERSION;
+        header.fileSize = info.size();
+        header.mtime = info.lastModified().toMSecsSinceEpoch();
+        header.streamIndex = streamIndex;
+        header.count = static_cast<uint32_t>(entries.size());
+
+        const QString path = cachePath(filePath);
+        const QString tmpPath = path + ".tmp";
+        if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+            return AVERROR(EACCES);
+        }
+
+        {
+            QFile file(tmpPath);
+            if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+                return AVERROR(EACCES);
+            }
+
+            const qint64 headerBytes = static_cast<qint64>(sizeof(Header));
+            const qint64 bytes = static_cast<qint64>(entries.size() * sizeof(KeyframeEntry));
+            if (file.write(reinterpret_cast<const char*>(&header), headerBytes) != headerBytes ||
+                file.write(reinterpret_cast<const char*>(entries.data()), bytes) != bytes) {
+                file.close();
+                QFile::remove(tmpPath);
+                return AVERROR(EIO);
+            }
+        }
+
+        QFile::remove(path);
+        if (!QFile::rename(tmpPath, path)) {
+            QFile::remove(tmpPath);
+            return AVERROR(EIO);
+        }
+
+        return open(filePath, streamIndex);
+    }
+
+    void KeyframeIndex::close() {
+        if (file_ && entries_) {
+            file_->unmap(reinterpret_cast<uchar*>(const_cast<KeyframeEntry*>(entries_)) - sizeof(Header));
+        }
+
+        file_.reset();
+        entries_ = nullptr;
+        count_ = 0;
+    }
+
+    // Last keyframe at or before timestamp; seeking there never overshoots the target.
+    bool KeyframeIndex::lookup(int64_t timestamp, KeyframeEntry* entry) const {
+        if (!entries_ || !entry) {
+            return false;
+        }
+
+        const KeyframeEntry* end = entries_ + count_;
+        const KeyframeEntry* it = std::upper_bound(entries_, end, timestamp,
+            [](int64_t ts, const KeyframeEntry& e) { return ts < e.pts; });
+
+        *entry = (it == entries_) ? entries_[0] : *(it - 1);
+        return true;
+    }
+
+    int KeyframeIndex::interruptCallback(void* opaque) {
+        const std::atomic<bool>* abort = static_cast<const std::atomic<bool>*>(opaque);
+        return (abort && abort->load()) ? 1 : 0;
+    }
+
+} // namespace media
\ No newline at end of file
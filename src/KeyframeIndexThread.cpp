@@ -0,0 +1,56 @@
+#include "KeyframeIndexThread.h"
+
+KeyframeIndexThread::KeyframeIndexThread(QObject* parent, const QString& filePath, int streamIndex)
+    : QThread(parent)
+    , index_(std::make_shared<media::KeyframeIndex>())
+    , filePath_(filePath)
+    , streamIndex_(streamIndex)
+    , ready_(false)
+    , abort_(false)
+    , started_(false) {
+}
+
+KeyframeIndexThread::~KeyframeIndexThread() {
+    stop();
+}
+
+void KeyframeIndexThread::start() {
+    if (started_.exchange(true)) {
+        return;
+    }
+
+    if (filePath_.isEmpty() || streamIndex_ < 0) {
+        return;
+    }
+
+    QThread::start(QThread::LowPriority);
+}
+
+void KeyframeIndexThread::stop() {
+    abort_.store(true);
+    requestInterruption();
+
+    if (!wait(3000)) {
+        terminate();
+        wait(1000);
+    }
+
+    started_.store(false);
+}
+
+std::shared_ptr<const media::KeyframeIndex> KeyframeIndexThread::index() const {
+    return ready_.load() ? index_ : nullptr;
+}
+
+// A valid sidecar is used as is; otherwise the file is scanned once in the background.
+void KeyframeIndexThread::run() {
+    int ret = index_->open(filePath_, streamIndex_);
+    if (ret < 0) {
+        ret = index_->build(filePath_, streamIndex_, abort_);
+    }
+
+    if (ret >= 0 && !abort_.load()) {
+        ready_.store(true);
+        emit indexReady();
+    }
+}
\ No newline at end of file
@@ -1,92 +1,220 @@
 #include "MediaContext.h"
 
-std::unique_ptr<MediaContext> MediaContext::instance_;
-std::once_flag MediaContext::flag_;
-
 MediaContext::MediaContext()
     : url_("")
     , error_("")
     , mediaInput_(std::make_unique<media::MediaInput>())
     , mediaDecoder_(std::make_unique<media::MediaDecoder>())
-    , mediaResampler_(std::make_unique<media::MediaResampler>()) {
+    , mediaResampler_(std::make_unique<media::MediaResampler>())
+    , open_(std::make_shared<OpenState>()) {
+    open_->owner = this;
 }
 
+// Pending opens are not joined, one stalled in the network would block the caller until
+// its timeout. They are detached from this instance and finish on their own.
 MediaContext::~MediaContext() {
+    {
+        std::lock_guard<std::mutex> locker(open_->mutex);
+        ++open_->serial;
+        open_->owner = nullptr;
+    }
+
     reset();
 }
 
-MediaContext* MediaContext::instance() {
-    std::call_once(flag_, []() {
-        instance_.reset(new MediaContext());
-        });
-    return instance_.get();
+int MediaContext::playFileStream(const std::string& url) {
+    return playStream(url, false);
 }
 
-int MediaContext::playFileStream(const std::string& url) {
-    std::lock_guard<std::mutex> locker(mutex_);
-    if (url.empty()) {
-        error_ = "File url is NULL";
-        return AVERROR(EINVAL);
+int MediaContext::playNetworkStream(const std::string& url) {
+    return playStream(url, true);
+}
+
+int MediaContext::playStream(const std::string& url, bool network) {
+    Streams streams;
+    std::string error;
+
+    OpenOptions options;
+    {
+        std::lock_guard<std::mutex> locker(open_->mutex);
+        options = options_;
     }
 
-    url_.clear();
-    url_ = url;
+    int ret = openStreams(url, network, options, streams, error, nullptr);
 
-    int ret = mediaInput_->openFileStream(url);
+    std::lock_guard<std::mutex> locker(mutex_);
     if (ret < 0) {
-        error_ = "Open file failed: " + url;
+        error_ = error;
         return ret;
     }
 
-    if (!mediaInput_->hasVideoStream() && !mediaInput_->hasAudioStream()) {
-        error_ = "Not found video and audio: " + url;
-        return AVERROR(EINVAL);
-    }
+    install(url, streams);
+    return 0;
+}
 
-    ret = openDecoder();
-    if (ret < 0) {
-        return ret;
+uint64_t MediaContext::openAsync(const std::string& url, bool network, StageCallback onStage, FinishCallback onFinish) {
+    std::lock_guard<std::mutex> locker(open_->mutex);
+
+    const uint64_t id = ++open_->serial;
+    const OpenOptions options = options_;
+    std::shared_ptr<OpenState> state = open_;
+
+    // Only reaches the context through state, which drops the owner when it is destroyed.
+    std::thread thread([state, id, url, network, options, onStage, onFinish]() {
+        Streams streams;
+        std::string error;
+
+        int ret = openStreams(url, network, options, streams, error, [&](OpenStage stage, int64_t elapsed) {
+            std::lock_guard<std::mutex> locker(state->mutex);
+            if (id != state->serial) {
+                return false;
+            }
+            if (onStage) {
+                onStage(id, stage, elapsed);
+            }
+            return true;
+            });
+
+        {
+            std::lock_guard<std::mutex> locker(state->mutex);
+            if (id == state->serial && state->owner) {
+                MediaContext* owner = state->owner;
+                {
+                    std::lock_guard<std::mutex> ctxLocker(owner->mutex_);
+                    if (ret < 0) {
+                        owner->error_ = error;
+                    }
+                    else {
+                        owner->install(url, streams);
+                    }
+                }
+
+                if (onFinish) {
+                    onFinish(id, ret, error);
+                }
+            }
+        }
+
+        // A cancelled request releases its half-opened streams here, off the caller's thread.
+        streams = Streams();
+        });
+
+    thread.detach();
+    return id;
+}
+
+void MediaContext::cancelOpen() {
+    std::lock_guard<std::mutex> locker(open_->mutex);
+    ++open_->serial;
+}
+
+void MediaContext::setOutputSampleRate(int samplerate) {
+    std::lock_guard<std::mutex> locker(open_->mutex);
+    options_.samplerate = samplerate > 0 ? samplerate : 0;
+}
+
+int MediaContext::outputSampleRate() const {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return openedOptions_.samplerate;
+}
+
+void MediaContext::setDecodeThreading(const media::DecodeThreadPolicy& policy) {
+    std::lock_guard<std::mutex> locker(open_->mutex);
+    options_.threading = policy;
+}
+
+media::DecodeThreadPolicy MediaContext::decodeThreading() const {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return openedOptions_.threading;
+}
+
+AVCodecContext* MediaContext::videoDecoder() const {
+    std::lock_guard<std::mutex> locker(mutex_);
+    return videoDecoder_.get();
+}
+
+AVCodecContext* MediaContext::reopenVideoDecoder(int threads) {
+    std::lock_guard<std::mutex> locker(mutex_);
+    if (!videoDecoder_ || !mediaInput_ || !mediaInput_->hasVideoStream()) {
+        return nullptr;
     }
 
-    ret = openResampler();
+    media::CodecContextPtr codecCtx;
+    int ret = openVideoCodec(mediaInput_->inputContext(), mediaInput_->videoParams().index,
+                             openedOptions_.threading, threads, codecCtx);
     if (ret < 0) {
-        return ret;
+        return nullptr;
     }
 
-    return 0;
+    videoDecoder_ = std::move(codecCtx);
+    return videoDecoder_.get();
 }
 
-int MediaContext::playNetworkStream(const std::string& url) {
-    std::lock_guard<std::mutex> locker(mutex_);
+// Caller must hold mutex_.
+void MediaContext::install(const std::string& url, Streams& streams) {
+    url_ = url;
+    error_.clear();
+
+    mediaResampler_ = std::move(streams.resampler);
+    videoDecoder_ = std::move(streams.video);
+    mediaDecoder_ = std::move(streams.decoder);
+    mediaInput_ = std::move(streams.input);
+    openedOptions_ = streams.options;
+}
+
+int MediaContext::openStreams(const std::string& url, bool network, const OpenOptions& options, Streams& streams, std::string& error,
+                              const std::function<bool(OpenStage, int64_t)>& onStage) {
+    auto begin = std::chrono::steady_clock::now();
+    auto finishStage = [&](OpenStage stage) {
+        auto now = std::chrono::steady_clock::now();
+        int64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - begin).count();
+        begin = now;
+        return !onStage || onStage(stage, elapsed);
+    };
+
     if (url.empty()) {
-        error_ = "Network url is NULL";
+        error = network ? "Network url is NULL" : "File url is NULL";
         return AVERROR(EINVAL);
     }
 
-    url_.clear();
-    url_ = url;
+    streams.input = std::make_unique<media::MediaInput>();
+    streams.decoder = std::make_unique<media::MediaDecoder>();
+    streams.resampler = std::make_unique<media::MediaResampler>();
+    streams.options = options;
 
-    int ret = mediaInput_->openNetworkStream(url);
+    int ret = network ? streams.input->openNetworkStream(url) : streams.input->openFileStream(url);
     if (ret < 0) {
-        error_ = "Open network failed: " + url;
+        error = (network ? "Open network failed: " : "Open file failed: ") + url;
         return ret;
     }
 
-    if (!mediaInput_->hasVideoStream() && !mediaInput_->hasAudioStream()) {
-        error_ = "Not found video and audio: " + url;
+    if (!streams.input->hasVideoStream() && !streams.input->hasAudioStream()) {
+        error = "Not found video and audio: " + url;
         return AVERROR(EINVAL);
     }
 
-    ret = openDecoder();
+    if (!finishStage(OpenStage::OpenInput)) {
+        return AVERROR_EXIT;
+    }
+
+    ret = openDecoder(streams, error);
     if (ret < 0) {
         return ret;
     }
 
-    ret = openResampler();
+    if (!finishStage(OpenStage::OpenDecoder)) {
+        return AVERROR_EXIT;
+    }
+
+    ret = openResampler(streams, error);
     if (ret < 0) {
         return ret;
     }
 
+    if (!finishStage(OpenStage::OpenResampler)) {
+        return AVERROR_EXIT;
+    }
+
     return 0;
 }
 
@@ -97,8 +225,10 @@ void MediaContext::reset() {
     error_.clear();
 
     mediaResampler_.reset();
+    videoDecoder_.reset();
     mediaDecoder_.reset();
     mediaInput_.reset();
+    openedOptions_ = OpenOptions();
 
     mediaInput_ = std::make_unique<media::MediaInput>();
     mediaDecoder_ = std::make_unique<media::MediaDecoder>();
@@ -115,19 +245,20 @@ std::string MediaContext::error() const {
     return error_;
 }
 
-int MediaContext::openDecoder() {
-    if (mediaInput_->hasVideoStream()) {
-        int ret = mediaDecoder_->openVideoDecoder(mediaInput_->inputContext());
+int MediaContext::openDecoder(Streams& streams, std::string& error) {
+    if (streams.input->hasVideoStream()) {
+        int ret = openVideoCodec(streams.input->inputContext(), streams.input->videoParams().index,
+                                 streams.options.threading, 0, streams.video);
         if (ret < 0) {
-            error_ = "Open video decoder failed";
+            error = "Open video decoder failed";
             return ret;
         }
     }
 
-    if (mediaInput_->hasAudioStream()) {
-        int ret = mediaDecoder_->openAudioDecoder(mediaInput_->inputContext());
+    if (streams.input->hasAudioStream()) {
+        int ret = streams.decoder->openAudioDecoder(streams.input->inputContext());
         if (ret < 0) {
-            error_ = "Open audio decoder failed";
+            error = "Open audio decoder failed";
             return ret;
         }
     }
@@ -135,23 +266,70 @@ int MediaContext::openDecoder() {
     return 0;
 }
 
-int MediaContext::openResampler() {
-    if (mediaDecoder_->videoDecoder()) {
-        const media::VideoParams& vp = mediaInput_->videoParams();
-        int ret = mediaResampler_->configSwsContext(vp.width, vp.height, vp.pixfmt,
+// threads > 0 overrides the count chosen by the policy.
+int MediaContext::openVideoCodec(AVFormatContext* inputCtx, int index, const media::DecodeThreadPolicy& policy,
+                                 int threads, media::CodecContextPtr& codecCtx) {
+    if (!inputCtx || index < 0 || index >= static_cast<int>(inputCtx->nb_streams)) {
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+
+    AVStream* stream = inputCtx->streams[index];
+    const AVCodec* codec = avcodec_find_decoder(stream->codecpar->codec_id);
+    if (!codec) {
+        return AVERROR_DECODER_NOT_FOUND;
+    }
+
+    media::CodecContextPtr ctx(avcodec_alloc_context3(codec));
+    if (!ctx) {
+        return AVERROR(ENOMEM);
+    }
+
+    int ret = avcodec_parameters_to_context(ctx.get(), stream->codecpar);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ctx->time_base = stream->time_base;
+    ctx->pkt_timebase = stream->time_base;
+    ctx->framerate = av_guess_frame_rate(inputCtx, stream, nullptr);
+
+    media::DecodeThreadSetup setup = media::DecodeThreading::choose(policy, codec, ctx->width, ctx->height);
+    if (threads > 0) {
+        setup.count = threads;
+    }
+    media::DecodeThreading::apply(ctx.get(), setup);
+
+    ret = avcodec_open2(ctx.get(), codec, nullptr);
+    if (ret < 0) {
+        return ret;
+    }
+
+    media::DecodeThreading::decoderOpened();
+    codecCtx = std::move(ctx);
+    return 0;
+}
+
+int MediaContext::openResampler(Streams& streams, std::string& error) {
+    if (streams.video) {
+        const media::VideoParams& vp = streams.input->videoParams();
+        int ret = streams.resampler->configSwsContext(vp.width, vp.height, vp.pixfmt,
                                                     vp.width, vp.height, TARGET_PIXEL_FORMAT);
         if (ret < 0) {
-            error_ = "Config sws context failed";
+            error = "Config sws context failed";
             return ret;
         }
     }
 
-    if (mediaDecoder_->audioDecoder()) {
-        const media::AudioParams& ap = mediaInput_->audioParams();
-        int ret = mediaResampler_->configSwrContext(ap.samplerate, ap.chlayout, ap.samplefmt,
-                                                    ap.samplerate, TARGET_CHANNEL_LAYOUT, TARGET_SAMPLE_FORMAT);
+    if (streams.decoder->audioDecoder()) {
+        const media::AudioParams& ap = streams.input->audioParams();
+        if (streams.options.samplerate <= 0) {
+            streams.options.samplerate = ap.samplerate;
+        }
+
+        int ret = streams.resampler->configSwrContext(ap.samplerate, ap.chlayout, ap.samplefmt,
+                                                    streams.options.samplerate, TARGET_CHANNEL_LAYOUT, TARGET_SAMPLE_FORMAT);
         if (ret < 0) {
-            error_ = "Config swr context failed";
+            error = "Config swr context failed";
             return ret;
         }
     }
@@ -0,0 +1,176 @@
+#include "MediaFramePool.h"
+
+namespace media {
+
+    MediaFramePool::MediaFramePool()
+        : pools_{}
+        , linesize_{}
+        , planes_(0)
+        , format_(-1)
+        , width_(0)
+        , height_(0)
+        , samples_(0)
+        , layout_{} {
+    }
+
+    MediaFramePool::~MediaFramePool() {
+        reset();
+    }
+
+    int MediaFramePool::configVideo(AVPixelFormat format, int width, int height) {
+        if (format == AV_PIX_FMT_NONE || width <= 0 || height <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (planes_ > 0 && format_ == format && width_ == width && height_ == height) {
+            return 0;
+        }
+
+        releasePools();
+
+        int linesizes[4] = { 0 };
+        int ret = av_image_fill_linesizes(linesizes, format, (width + ALIGN - 1) & ~(ALIGN - 1));
+        if (ret < 0) {
+            return ret;
+        }
+
+        ptrdiff_t strides[4] = { 0 };
+        for (int i = 0; i < 4; ++i) {
+            linesizes[i] = (linesizes[i] + ALIGN - 1) & ~(ALIGN - 1);
+            strides[i] = linesizes[i];
+        }
+
+        size_t sizes[4] = { 0 };
+        ret = av_image_fill_plane_sizes(sizes, format, height, strides);
+        if (ret < 0) {
+            return ret;
+        }
+
+        int planes = 0;
+        while (planes < 4 && sizes[planes] > 0) {
+            linesize_[planes] = linesizes[planes];
+            ++planes;
+        }
+
+        ret = createPools(sizes, planes);
+        if (ret < 0) {
+            return ret;
+        }
+
+        format_ = format;
+        width_ = width;
+        height_ = height;
+        samples_ = 0;
+        return 0;
+    }
+
+    int MediaFramePool::configAudio(AVSampleFormat format, const AVChannelLayout& layout, int samples) {
+        if (format == AV_SAMPLE_FMT_NONE || layout.nb_channels <= 0 || samples <= 0) {
+            return AVERROR(EINVAL);
+        }
+
+        if (planes_ > 0 && format_ == format && samples <= samples_ &&
+            av_channel_layout_compare(&layout_, &layout) == 0) {
+            return 0;
+        }
+
+        releasePools();
+
+        // Round up so small variations in nb_samples do not re-create the pool.
+        samples = (samples + 1023) & ~1023;
+
+        int linesize = 0;
+        int ret = av_samples_get_buffer_size(&linesize, layout.nb_channels, samples, format, ALIGN);
+        if (ret < 0) {
+            return ret;
+        }
+
+        int planes = av_sample_fmt_is_planar(format) ? layout.nb_channels : 1;
+        if (planes > AV_NUM_DATA_POINTERS) {
+            return AVERROR(ENOSYS);
+        }
+
+        size_t sizes[AV_NUM_DATA_POINTERS] = { 0 };
+        for (int i = 0; i < planes; ++i) {
+            sizes[i] = linesize;
+            linesize_[i] = linesize;
+        }
+
+        ret = createPools(sizes, planes);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = av_channel_layout_copy(&layout_, &layout);
+        if (ret < 0) {
+            releasePools();
+            return ret;
+        }
+
+        format_ = format;
+        width_ = 0;
+        height_ = 0;
+        samples_ = samples;
+        return 0;
+    }
+
+    int MediaFramePool::getBuffer(AVFrame* frame, int firstPlane) {
+        if (!frame || planes_ <= 0 || frame->format != format_) {
+            return AVERROR(EINVAL);
+        }
+
+        if (samples_ > 0 && frame->nb_samples > samples_) {
+            return AVERROR(EINVAL);
+        }
+
+        for (int i = firstPlane; i < planes_; ++i) {
+            frame->buf[i] = av_buffer_pool_get(pools_[i]);
+            if (!frame->buf[i]) {
+                av_frame_unref(frame);
+                return AVERROR(ENOMEM);
+            }
+
+            frame->data[i] = frame->buf[i]->data;
+            frame->linesize[i] = linesize_[i];
+        }
+
+        frame->extended_data = frame->data;
+        return 0;
+    }
+
+    void MediaFramePool::reset() {
+        releasePools();
+    }
+
+    int MediaFramePool::createPools(const size_t sizes[], int planes) {
+        for (int i = 0; i < planes; ++i) {
+            // Converters may read or write slightly past the last line.
+            pools_[i] = av_buffer_pool_init(sizes[i] + ALIGN, av_buffer_allocz);
+            if (!pools_[i]) {
+                releasePools();
+                return AVERROR(ENOMEM);
+            }
+        }
+
+        planes_ = planes;
+        return 0;
+    }
+
+    void MediaFramePool::releasePools() {
+        for (int i = 0; i < AV_NUM_DATA_POINTERS; ++i) {
+            if (pools_[i]) {
+                av_buffer_pool_uninit(&pools_[i]);
+                pools_[i] = nullptr;
+            }
+            linesize_[i] = 0;
+        }
+
+        av_channel_layout_uninit(&layout_);
+        planes_ = 0;
+        format_ = -1;
+        width_ = 0;
+        height_ = 0;
+        samples_ = 0;
+    }
+
+} // namespace media
\ No newline at end of file
@@ -0,0 +1,235 @@
+#include "SliceScaler.h"
+
+namespace media {
+
+    SliceScaler::SliceScaler()
+        : src_(av_frame_alloc())
+        , dst_(nullptr)
+        , srcWidth_(0)
+        , srcHeight_(0)
+        , srcFormat_(AV_PIX_FMT_NONE)
+        , dstWidth_(0)
+        , dstHeight_(0)
+        , dstFormat_(AV_PIX_FMT_NONE)
+        , job_(0)
+        , remaining_(0)
+        , error_(0)
+        , start_(0)
+        , elapsed_(0)
+        , busy_(false)
+        , quit_(false) {
+    }
+
+    SliceScaler::~SliceScaler() {
+        reset();
+        av_frame_free(&src_);
+    }
+
+    int SliceScaler::config(int srcWidth, int srcHeight, AVPixelFormat srcFormat,
+                            int dstWidth, int dstHeight, AVPixelFormat dstFormat, int slices) {
+        if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0 ||
+            srcFormat == AV_PIX_FMT_NONE || dstFormat == AV_PIX_FMT_NONE) {
+            return AVERROR(EINVAL);
+        }
+
+        if (busy()) {
+            wait();
+        }
+
+        if (slices <= 0) {
+            int cores = static_cast<int>(std::thread::hardware_concurrency());
+            slices = std::max(1, std::min(srcHeight / MIN_SLICE_HEIGHT, std::max(1, cores)));
+        }
+
+        int rows = ((dstHeight + slices - 1) / slices + ALIGN - 1) & ~(ALIGN - 1);
+        int count = (dstHeight + rows - 1) / rows;
+
+        if (!slices_.empty() && srcWidth_ == srcWidth && srcHeight_ == srcHeight && srcFormat_ == srcFormat &&
+            dstWidth_ == dstWidth && dstHeight_ == dstHeight && dstFormat_ == dstFormat &&
+            static_cast<int>(slices_.size()) == count) {
+            return 0;
+        }
+
+        stopWorkers();
+        releaseSlices();
+
+        if (!av_pix_fmt_desc_get(srcFormat) || !av_pix_fmt_desc_get(dstFormat)) {
+            return AVERROR(EINVAL);
+        }
+
+        for (int y = 0; y < dstHeight; y += rows) {
+            int h = std::min(rows, dstHeight - y);
+            SwsContext* ctx = sws_getContext(srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, dstFormat,
+                                             SWS_BILINEAR, nullptr, nullptr, nullptr);
+            if (!ctx || rows % static_cast<int>(sws_receive_slice_alignment(ctx)) != 0) {
+                sws_freeContext(ctx);
+                releaseSlices();
+                return AVERROR(EINVAL);
+            }
+            slices_.push_back({ ctx, y, h });
+        }
+
+        srcWidth_ = srcWidth;
+        srcHeight_ = srcHeight;
+        srcFormat_ = srcFormat;
+        dstWidth_ = dstWidth;
+        dstHeight_ = dstHeight;
+        dstFormat_ = dstFormat;
+
+        startWorkers(slices_.size());
+        return 0;
+    }
+
+    int SliceScaler::submit(const AVFrame* src, AVFrame* dst) {
+        if (!src || !dst || !src_) {
+            return AVERROR(EINVAL);
+        }
+
+        std::lock_guard<std::mutex> locker(mutex_);
+        if (busy_) {
+            return AVERROR(EBUSY);
+        }
+
+        if (slices_.empty() || src->width != srcWidth_ || src->height != srcHeight_ || src->format != srcFormat_ ||
+            dst->width != dstWidth_ || dst->height != dstHeight_ || dst->format != dstFormat_) {
+            return AVERROR(EINVAL);
+        }
+
+        int ret = av_frame_ref(src_, src);
+        if (ret < 0) {
+            return ret;
+        }
+
+        dst_ = dst;
+        remaining_ = slices_.size();
+        error_ = 0;
+        elapsed_ = 0;
+        start_ = now();
+        busy_ = true;
+        ++job_;
+        jobWc_.notify_all();
+        return 0;
+    }
+
+    int64_t SliceScaler::wait() {
+        std::unique_lock<std::mutex> locker(mutex_);
+        if (!busy_) {
+            return AVERROR(EINVAL);
+        }
+
+        doneWc_.wait(locker, [this]() { return remaining_ == 0; });
+
+        busy_ = false;
+        dst_ = nullptr;
+        av_frame_unref(src_);
+        return error_ < 0 ? error_ : elapsed_;
+    }
+
+    bool SliceScaler::busy() const {
+        std::lock_guard<std::mutex> locker(mutex_);
+        return busy_;
+    }
+
+    void SliceScaler::reset() {
+        if (busy()) {
+            wait();
+        }
+
+        stopWorkers();
+        releaseSlices();
+
+        srcWidth_ = 0;
+        srcHeight_ = 0;
+        srcFormat_ = AV_PIX_FMT_NONE;
+        dstWidth_ = 0;
+        dstHeight_ = 0;
+        dstFormat_ = AV_PIX_FMT_NONE;
+    }
+
+    // Workers start from the job count of this moment, a submit() right after config() must
+    // not be mistaken for one they already ran.
+    void SliceScaler::startWorkers(size_t count) {
+        uint64_t job;
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            quit_ = false;
+            job = job_;
+        }
+
+        for (size_t i = 0; i < count; ++i) {
+            workers_.emplace_back(&SliceScaler::worker, this, i, job);
+        }
+    }
+
+    void SliceScaler::stopWorkers() {
+        {
+            std::lock_guard<std::mutex> locker(mutex_);
+            quit_ = true;
+        }
+        jobWc_.notify_all();
+
+        for (std::thread& worker : workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        workers_.clear();
+    }
+
+    void SliceScaler::releaseSlices() {
+        for (Slice& slice : slices_) {
+            sws_freeContext(slice.ctx);
+        }
+        slices_.clear();
+    }
+
+    void SliceScaler::worker(size_t index, uint64_t seen) {
+        std::unique_lock<std::mutex> locker(mutex_);
+
+        while (true) {
+            jobWc_.wait(locker, [this, seen]() { return quit_ || job_ != seen; });
+            if (quit_) {
+                return;
+            }
+            seen = job_;
+
+            const Slice slice = slices_[index];
+            locker.unlock();
+            int ret = convert(slice);
+            locker.lock();
+
+            if (ret < 0) {
+                error_ = ret;
+            }
+
+            if (--remaining_ == 0) {
+                elapsed_ = now() - start_;
+                doneWc_.notify_all();
+            }
+        }
+    }
+
+    // Every band context sees the whole source and produces only its own output rows, the
+    // source rows each band needs around its edges (for scaling or vertical chroma
+    // resampling) are picked by swscale itself, so band borders leave no seams.
+    int SliceScaler::convert(const Slice& slice) {
+        int ret = sws_frame_start(slice.ctx, dst_, src_);
+        if (ret < 0) {
+            return ret;
+        }
+
+        ret = sws_send_slice(slice.ctx, 0, srcHeight_);
+        if (ret >= 0) {
+            ret = sws_receive_slice(slice.ctx, slice.y, slice.height);
+        }
+
+        sws_frame_end(slice.ctx);
+        return ret < 0 ? ret : 0;
+    }
+
+    int64_t SliceScaler::now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+} // namespace media
\ No newline at end of file
@@ -1,55 +1,146 @@
 #include "VideoDecodeThread.h"
 
-VideoDecodeThread::VideoDecodeThread(QObject* parent, std::shared_ptr<MediaBuffer> buffer)
+VideoDecodeThread::VideoDecodeThread(QObject* parent)
     : QThread(parent)
-    , buffer_(buffer)
     , decCtx_(nullptr)
-    , swsCtx_(nullptr)
     , decFrm_(nullptr)
-    , yuvFrm_(nullptr)
+    , convFrm_(nullptr)
     , initError_("")
+    , bindError_("")
+    , frameRate_(0.0)
+    , serial_(0)
+    , seekTarget_(AV_NOPTS_VALUE)
+    , tuneStart_(0)
+    , busyTime_(0)
+    , decodedFrames_(0)
+    , pendingThreads_(0)
+    , govStart_(0)
+    , govBusy_(0)
+    , govPackets_(0)
+    , govHold_(0)
+    , srcWidth_(0)
+    , srcHeight_(0)
+    , outWidth_(0)
+    , outHeight_(0)
+    , scaleFailed_(false)
+    , convertFailed_(false)
+    , parked_(false)
     , inited_(false)
-    , flush_(false)
+    , bound_(false)
     , running_(false)
-    , started_(false) {
+    , started_(false)
+    , speed_(1.0f)
+    , viewWidth_(0)
+    , viewHeight_(0)
+    , degradeLevel_(0) {
 
     do {
-        if (!buffer) {
-            initError_ = "Media buffer is NULL";
+        decFrm_ = av_frame_alloc();
+        if (!decFrm_) {
+            initError_ = "AVFrame alloc failed";
             break;
         }
 
-        decCtx_ = MCTX()->mediaDecoder()->videoDecoder();
-        if (!decCtx_) {
-            initError_ = "Video decoder context is NULL";
+        inited_.store(true);
+
+    } while (0);
+
+    if (!inited_.load()) {
+        cleanup();
+    }
+}
+
+VideoDecodeThread::~VideoDecodeThread() {
+    stop();
+    unbind();
+    cleanup();
+}
+
+bool VideoDecodeThread::bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    unbind();
+
+    do {
+        if (!context) {
+            bindError_ = "Media context is NULL";
             break;
         }
 
-        swsCtx_ = MCTX()->mediaResampler()->swsContext();
-        if (!swsCtx_) {
-            initError_ = "Sws context is NULL";
+        if (!buffer) {
+            bindError_ = "Media buffer is NULL";
             break;
         }
 
-        decFrm_ = av_frame_alloc();
-        yuvFrm_ = av_frame_alloc();
-        if (!decFrm_ || !yuvFrm_) {
-            initError_ = "AVFrame alloc failed";
+        AVCodecContext* decCtx = context->videoDecoder();
+        if (!decCtx) {
+            bindError_ = "Video decoder context is NULL";
             break;
         }
 
-        inited_.store(true);
+        QMutexLocker locker(&bindMutex_);
+        context_ = std::move(context);
+        buffer_ = std::move(buffer);
+        decCtx_ = decCtx;
+        policy_ = context_->decodeThreading();
+        frameRate_ = av_q2d(decCtx->framerate);
+        serial_ = buffer_->serial();
+        seekTarget_ = AV_NOPTS_VALUE;
+        pendingThreads_ = 0;
+        srcWidth_ = 0;
+        srcHeight_ = 0;
+        scaleFailed_ = false;
+        convertFailed_ = false;
+        resetTuning();
+        degradeLevel_.store(0);
+        resetGovernor();
+        applyDegradeLevel();
+
+        bound_.store(true);
+        bindWc_.wakeAll();
+        return true;
 
     } while (0);
 
-    if (!inited_.load()) {
-        cleanup();
+    return false;
+}
+
+void VideoDecodeThread::unbind() {
+    bound_.store(false);
+
+    if (buffer_) {
+        buffer_->wakeup();
     }
+
+    QMutexLocker locker(&bindMutex_);
+    while (isRunning() && running_.load() && !parked_) {
+        bindWc_.wait(&bindMutex_);
+    }
+
+    discardConversion();
+
+    if (decFrm_) {
+        av_frame_unref(decFrm_);
+    }
+
+    context_.reset();
+    buffer_.reset();
+    decCtx_ = nullptr;
 }
 
-VideoDecodeThread::~VideoDecodeThread() {
-    stop();
-    cleanup();
+QString VideoDecodeThread::bindError() const {
+    return bindError_;
+}
+
+void VideoDecodeThread::setSpeed(float speed) {
+    speed_.store(speed);
+}
+
+void VideoDecodeThread::setOutputSize(int width, int height) {
+    viewWidth_.store(qMax(0, width));
+    viewHeight_.store(qMax(0, height));
+}
+
+int VideoDecodeThread::degradeLevel() const {
+    return degradeLevel_.load();
 }
 
 void VideoDecodeThread::start() {
@@ -58,6 +149,7 @@ void VideoDecodeThread::start() {
     }
 
     if (!inited_.load()) {
+        started_.store(false);
         emit videoDecodeError(initError_);
         return;
     }
@@ -71,8 +163,15 @@ void VideoDecodeThread::stop() {
     }
 
     running_.store(false);
-    flush_.store(false);
     requestInterruption();
+    {
+        QMutexLocker locker(&bindMutex_);
+        bindWc_.wakeAll();
+    }
+
+    if (buffer_) {
+        buffer_->wakeup();
+    }
 
     if (!wait(3000)) {
         terminate();
@@ -82,33 +181,62 @@ void VideoDecodeThread::stop() {
     started_.store(false);
 }
 
-void VideoDecodeThread::onFlushRequest() {
-    if (!running_.load()) {
-        return;
-    }
-
-    flush_.store(true);
-}
-
 void VideoDecodeThread::run() {
     running_.store(true);
 
     while (running_.load() && !isInterruptionRequested()) {
-        if (flush_.exchange(false)) {
-            if (decCtx_) {
-                avcodec_flush_buffers(decCtx_);
-            }
+        if (!bound_.load()) {
+            discardConversion();
+            park();
             continue;
         }
 
-        AVPacket* packet = reinterpret_cast<AVPacket*>(buffer_->dequeue<media::VIDEO, media::DEMUXING>());
+        // With a conversion in flight only poll, so a stalled demuxer does not hold back the
+        // converted frame.
+        AVPacket* packet = buffer_->dequeue<media::VIDEO, media::DEMUXING>(convFrm_ ? 0 : media::MediaWait_Infinite);
         if (!packet) {
-            msleep(1);
+            finishConversion();
+            continue;
+        }
+
+        int64_t serial = media::itemSerial(packet);
+        if (serial < buffer_->serial()) {
+            buffer_->releasePacket(packet);
+            continue;
+        }
+
+        if (serial != serial_) {
+            discardConversion();
+            avcodec_flush_buffers(decCtx_);
+            serial_ = serial;
+            seekTarget_ = buffer_->seekTarget(serial);
+            resetTuning();
+            resetGovernor();
+        }
+
+        if (media::isEndOfStream(packet)) {
+            buffer_->releasePacket(packet);
+            flushDecoder();
+            finishConversion();
+            processEndOfStream();
             continue;
         }
 
+        // A keyframe is the only point where the old decoder can be drained and replaced
+        // without losing references.
+        if (pendingThreads_ > 0 && (packet->flags & AV_PKT_FLAG_KEY)) {
+            reopenDecoder();
+        }
+
+        updateSkipFrame(packet);
+
+        int64_t busyStart = now();
         int ret = avcodec_send_packet(decCtx_, packet);
-        av_packet_free(&packet);
+        int64_t busy = now() - busyStart;
+        busyTime_ += busy;
+        govBusy_ += busy;
+        govPackets_++;
+        buffer_->releasePacket(packet);
 
         if (ret < 0) {
             if (ret == AVERROR_EOF) {
@@ -119,7 +247,7 @@ void VideoDecodeThread::run() {
             }
             else {
                 emit videoDecodeError("Video decode thread send packet failed");
-                break;
+                bound_.store(false);
             }
             continue;
         }
@@ -127,8 +255,13 @@ void VideoDecodeThread::run() {
         bool innerError = false;
         while (running_.load() && !innerError) {
             av_frame_unref(decFrm_);
+            busyStart = now();
             ret = avcodec_receive_frame(decCtx_, decFrm_);
+            busy = now() - busyStart;
+            busyTime_ += busy;
+            govBusy_ += busy;
             if (ret == 0) {
+                decodedFrames_++;
                 processFrame();
             }
             else if (ret == AVERROR_EOF || ret == AVERROR(EAGAIN)) {
@@ -142,61 +275,432 @@ void VideoDecodeThread::run() {
         }
 
         if (innerError) {
-            break;
+            bound_.store(false);
+        }
+        else {
+            updateTuning();
+            updateGovernor();
         }
     }
 
+    discardConversion();
     running_.store(false);
 }
 
 void VideoDecodeThread::processFrame() {
-    if (!decFrm_ || !yuvFrm_ || !swsCtx_ || !decCtx_ || !buffer_) {
+    if (!decFrm_ || !decCtx_ || !buffer_) {
         return;
     }
 
+    if (decFrm_->pts == AV_NOPTS_VALUE) {
+        decFrm_->pts = decFrm_->best_effort_timestamp;
+    }
+    decFrm_->time_base = decCtx_->time_base;
+
+    if (seekTarget_ != AV_NOPTS_VALUE) {
+        if (beforeSeekTarget(decFrm_)) {
+            return;
+        }
+
+        seekTarget_ = AV_NOPTS_VALUE;
+        decCtx_->skip_frame = skipFrameBase();
+        emit seekReached(buffer_->seekElapsed());
+    }
+
+    // The previous frame goes out first, frames leave in decode order.
+    finishConversion();
+
+    updateOutputSize(decFrm_->width, decFrm_->height);
+    const bool scaling = outWidth_ != decFrm_->width || outHeight_ != decFrm_->height;
+
+    switch (scaling ? OutputPath::Convert : outputPath(decFrm_->format)) {
+    case OutputPath::SplitChroma:
+        splitChroma();
+        return;
+    case OutputPath::Convert:
+        startConversion();
+        return;
+    default:
+        break;
+    }
+
     AVFrame* frame = av_frame_alloc();
     if (!frame) {
         return;
     }
 
-    if (decFrm_->pts == AV_NOPTS_VALUE) {
-        decFrm_->pts = decFrm_->best_effort_timestamp;
+    av_frame_move_ref(frame, decFrm_);
+    if (!enqueueFrame(frame)) {
+        av_frame_free(&frame);
     }
-    decFrm_->time_base = decCtx_->time_base;
+}
 
-    if (decCtx_->pix_fmt == MediaContext::TARGET_PIXEL_FORMAT) {
-        av_frame_move_ref(frame, decFrm_);
+// Semi-planar 4:2:0 only differs from the renderer's layout in the interleaved chroma
+// plane. The luma plane is referenced rather than copied and only the chroma, a third of
+// the frame, is split into U and V.
+void VideoDecodeThread::splitChroma() {
+    AVBufferRef* luma = av_frame_get_plane_buffer(decFrm_, 0);
+    if (!luma) {
+        startConversion();
+        return;
     }
-    else {
-        av_frame_unref(yuvFrm_);
-        yuvFrm_->width = decCtx_->width;
-        yuvFrm_->height = decCtx_->height;
-        yuvFrm_->format = MediaContext::TARGET_PIXEL_FORMAT;
 
-        if (av_frame_get_buffer(yuvFrm_, 0) < 0) {
-            av_frame_free(&frame);
-            return;
+    int64_t start = now();
+
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    frame->width = decFrm_->width;
+    frame->height = decFrm_->height;
+    frame->format = MediaContext::TARGET_PIXEL_FORMAT;
+
+    if (framePool_.configVideo(MediaContext::TARGET_PIXEL_FORMAT, frame->width, frame->height) < 0 ||
+        framePool_.getBuffer(frame, 1) < 0) {
+        av_frame_free(&frame);
+        return;
+    }
+
+    frame->buf[0] = av_buffer_ref(luma);
+    if (!frame->buf[0] || av_frame_copy_props(frame, decFrm_) < 0) {
+        av_frame_free(&frame);
+        return;
+    }
+    frame->data[0] = decFrm_->data[0];
+    frame->linesize[0] = decFrm_->linesize[0];
+
+    uint8_t* u = frame->data[1];
+    uint8_t* v = frame->data[2];
+    if (decFrm_->format == AV_PIX_FMT_NV21) {
+        std::swap(u, v);
+    }
+
+    const int width = (frame->width + 1) / 2;
+    const int height = (frame->height + 1) / 2;
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* src = decFrm_->data[1] + static_cast<ptrdiff_t>(y) * decFrm_->linesize[1];
+        uint8_t* dstU = u + static_cast<ptrdiff_t>(y) * frame->linesize[1];
+        uint8_t* dstV = v + static_cast<ptrdiff_t>(y) * frame->linesize[2];
+        for (int x = 0; x < width; ++x) {
+            dstU[x] = src[2 * x];
+            dstV[x] = src[2 * x + 1];
         }
+    }
 
-        int ret = sws_scale(swsCtx_, decFrm_->data, decFrm_->linesize, 0,
-                            decFrm_->height, yuvFrm_->data, yuvFrm_->linesize);
-        if (ret < 0) {
-            av_frame_free(&frame);
+    emit frameConverted(now() - start);
+
+    if (!enqueueFrame(frame)) {
+        av_frame_free(&frame);
+    }
+}
+
+// The converted frame is only queued by finishConversion(), usually after the next frame
+// has been decoded in the meantime.
+// A scale swscale refuses falls back to the full size for the rest of the media, the
+// renderer stretches it anyway. A frame that cannot be converted at all is reported once.
+void VideoDecodeThread::startConversion() {
+    const int width = decFrm_->width;
+    const int height = decFrm_->height;
+    const AVPixelFormat format = static_cast<AVPixelFormat>(decFrm_->format);
+
+    if (scaler_.config(width, height, format, outWidth_, outHeight_, MediaContext::TARGET_PIXEL_FORMAT) < 0) {
+        if ((outWidth_ != width || outHeight_ != height) &&
+            scaler_.config(width, height, format, width, height, MediaContext::TARGET_PIXEL_FORMAT) >= 0) {
+            qWarning("Scaling video to %dx%d failed, converting at %dx%d", outWidth_, outHeight_, width, height);
+            scaleFailed_ = true;
+            outWidth_ = width;
+            outHeight_ = height;
+        }
+        else {
+            reportConvertError();
             return;
         }
+    }
 
-        yuvFrm_->pts = decFrm_->pts;
-        yuvFrm_->pkt_dts = decFrm_->pkt_dts;
-        yuvFrm_->duration = decFrm_->duration;
-        yuvFrm_->time_base = decFrm_->time_base;
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    frame->width = outWidth_;
+    frame->height = outHeight_;
+    frame->format = MediaContext::TARGET_PIXEL_FORMAT;
 
-        av_frame_move_ref(frame, yuvFrm_);
+    if (framePool_.configVideo(MediaContext::TARGET_PIXEL_FORMAT, frame->width, frame->height) < 0 ||
+        framePool_.getBuffer(frame) < 0) {
+        av_frame_free(&frame);
+        return;
     }
 
-    bool ok = buffer_->enqueue<AVFrame, media::VIDEO, media::DECODING>(frame);
-    if (!ok) {
+    frame->pts = decFrm_->pts;
+    frame->pkt_dts = decFrm_->pkt_dts;
+    frame->duration = decFrm_->duration;
+    frame->time_base = decFrm_->time_base;
+
+    if (scaler_.submit(decFrm_, frame) < 0) {
         av_frame_free(&frame);
+        reportConvertError();
+        return;
     }
+
+    convFrm_ = frame;
+}
+
+void VideoDecodeThread::reportConvertError() {
+    if (convertFailed_) {
+        return;
+    }
+
+    convertFailed_ = true;
+    emit videoDecodeError(QString("Video frame conversion from %1 failed")
+                          .arg(av_get_pix_fmt_name(static_cast<AVPixelFormat>(decFrm_->format))));
+}
+
+// Fits the frame into the viewport without upscaling, the renderer stretches whatever it
+// gets. The output size only follows the viewport once they differ by more than
+// OUTPUT_HYSTERESIS, so dragging the window edge does not rebuild the scaler every frame.
+void VideoDecodeThread::updateOutputSize(int width, int height) {
+    int w = width;
+    int h = height;
+
+    const int viewWidth = viewWidth_.load();
+    const int viewHeight = viewHeight_.load();
+    if (viewWidth > 0 && viewHeight > 0 && !scaleFailed_) {
+        double scale = std::min(static_cast<double>(viewWidth) / width, static_cast<double>(viewHeight) / height);
+        if (scale < 1.0 - OUTPUT_HYSTERESIS) {
+            w = std::min(width, (static_cast<int>(std::ceil(width * scale)) + 1) & ~1);
+            h = std::min(height, (static_cast<int>(std::ceil(height * scale)) + 1) & ~1);
+        }
+    }
+
+    if (srcWidth_ == width && srcHeight_ == height &&
+        std::abs(w - outWidth_) <= outWidth_ * OUTPUT_HYSTERESIS &&
+        std::abs(h - outHeight_) <= outHeight_ * OUTPUT_HYSTERESIS) {
+        return;
+    }
+
+    srcWidth_ = width;
+    srcHeight_ = height;
+    outWidth_ = w;
+    outHeight_ = h;
+}
+
+void VideoDecodeThread::finishConversion() {
+    if (!convFrm_) {
+        return;
+    }
+
+    AVFrame* frame = convFrm_;
+    convFrm_ = nullptr;
+
+    int64_t elapsed = scaler_.wait();
+    if (elapsed < 0) {
+        av_frame_free(&frame);
+        return;
+    }
+
+    emit frameConverted(elapsed);
+
+    if (!enqueueFrame(frame)) {
+        av_frame_free(&frame);
+    }
+}
+
+void VideoDecodeThread::discardConversion() {
+    if (!convFrm_) {
+        return;
+    }
+
+    scaler_.wait();
+    av_frame_free(&convFrm_);
+    convFrm_ = nullptr;
+}
+
+bool VideoDecodeThread::enqueueFrame(AVFrame* frame) {
+    media::setItemSerial(frame, serial_);
+
+    bool ok = false;
+    while (!ok && running_.load() && bound_.load() && serial_ >= buffer_->serial() && !isInterruptionRequested()) {
+        ok = buffer_->enqueue<media::VIDEO, media::DECODING>(frame, media::MediaWait_Infinite);
+    }
+
+    return ok;
+}
+
+// Non-reference frames that end before the seek target are never shown, so the decoder
+// may skip them entirely. Reference frames still have to be decoded to rebuild the target.
+void VideoDecodeThread::updateSkipFrame(const AVPacket* packet) {
+    const AVDiscard base = skipFrameBase();
+    if (seekTarget_ == AV_NOPTS_VALUE || packet->pts == AV_NOPTS_VALUE) {
+        decCtx_->skip_frame = base;
+        return;
+    }
+
+    int64_t end = av_rescale_q(packet->pts + (packet->duration > 0 ? packet->duration : 0),
+                               packet->time_base, AV_TIME_BASE_Q);
+    decCtx_->skip_frame = (end <= seekTarget_) ? std::max(AVDISCARD_NONREF, base) : base;
+}
+
+bool VideoDecodeThread::beforeSeekTarget(const AVFrame* frame) const {
+    if (frame->pts == AV_NOPTS_VALUE) {
+        return false;
+    }
+
+    int64_t pts = av_rescale_q(frame->pts, frame->time_base, AV_TIME_BASE_Q);
+    if (frame->duration > 0) {
+        return pts + av_rescale_q(frame->duration, frame->time_base, AV_TIME_BASE_Q) <= seekTarget_;
+    }
+    return pts < seekTarget_;
+}
+
+// Forwarded once the decoder is drained, so the play thread knows the item has ended.
+void VideoDecodeThread::processEndOfStream() {
+    AVFrame* frame = av_frame_alloc();
+    if (!frame) {
+        return;
+    }
+
+    if (!enqueueFrame(frame)) {
+        av_frame_free(&frame);
+    }
+}
+
+// Only time spent inside the decoder counts, waiting on a full frame queue would make a
+// paused or slow consumer look like a slow decoder. Frames decoded towards a seek target
+// are skipped cheaply, so those periods are not measured.
+void VideoDecodeThread::updateTuning() {
+    const int64_t current = now();
+    if (seekTarget_ != AV_NOPTS_VALUE || tuneStart_ == 0) {
+        resetTuning();
+        return;
+    }
+
+    if (current - tuneStart_ < TUNE_INTERVAL || decodedFrames_ < TUNE_FRAMES) {
+        return;
+    }
+
+    if (busyTime_ > 0 && frameRate_ > 0.0) {
+        double decodeFps = decodedFrames_ * 1000000.0 / busyTime_;
+        int threads = media::DecodeThreading::tune(policy_, decCtx_, decodeFps, frameRate_ * speed_.load());
+        if (threads > 0) {
+            pendingThreads_ = threads;
+        }
+    }
+
+    resetTuning();
+}
+
+void VideoDecodeThread::resetTuning() {
+    tuneStart_ = now();
+    busyTime_ = 0;
+    decodedFrames_ = 0;
+}
+
+void VideoDecodeThread::reopenDecoder() {
+    const int threads = pendingThreads_;
+    pendingThreads_ = 0;
+
+    flushDecoder();
+
+    AVCodecContext* decCtx = context_->reopenVideoDecoder(threads);
+    if (!decCtx) {
+        // The old decoder is kept, it only has to leave the drained state.
+        avcodec_flush_buffers(decCtx_);
+        qWarning("Reopen video decoder with %d threads failed", threads);
+        return;
+    }
+
+    decCtx_ = decCtx;
+    resetTuning();
+    applyDegradeLevel();
+    qInfo("Video decoder reopened with %d threads", threads);
+}
+
+// The renderer takes three 8 bit limited range 4:2:0 planes. Full range (YUVJ) and high
+// bit depth sources still need sws for the range and depth conversion.
+VideoDecodeThread::OutputPath VideoDecodeThread::outputPath(int format) {
+    switch (format) {
+    case AV_PIX_FMT_YUV420P:
+        return OutputPath::Direct;
+    case AV_PIX_FMT_NV12:
+    case AV_PIX_FMT_NV21:
+        return OutputPath::SplitChroma;
+    default:
+        return OutputPath::Convert;
+    }
+}
+
+// Packets rather than frames are counted, the higher steps make the decoder drop frames.
+// Frames decoded towards a seek target are not representative and reset the window.
+void VideoDecodeThread::updateGovernor() {
+    const int64_t current = now();
+    if (seekTarget_ != AV_NOPTS_VALUE || govStart_ == 0) {
+        resetGovernor();
+        return;
+    }
+
+    if (current - govStart_ < GOVERNOR_INTERVAL || govPackets_ < GOVERNOR_PACKETS || frameRate_ <= 0.0) {
+        return;
+    }
+
+    const double played = govPackets_ * 1000000.0 / (frameRate_ * std::max(0.1f, speed_.load()));
+    const double load = govBusy_ / played;
+    const bool starved = buffer_->empty<media::VIDEO, media::DECODING>();
+    int level = degradeLevel_.load();
+
+    if (load > STEP_UP || (starved && load > STEP_UP_STARVED)) {
+        level = std::min(level + 1, DEGRADE_LEVELS - 1);
+        govHold_ = 0;
+    }
+    else if (load < STEP_DOWN && !starved) {
+        if (++govHold_ >= GOVERNOR_HOLD) {
+            level = std::max(level - 1, 0);
+            govHold_ = 0;
+        }
+    }
+    else {
+        govHold_ = 0;
+    }
+
+    if (level != degradeLevel_.load()) {
+        degradeLevel_.store(level);
+        applyDegradeLevel();
+        emit degradeLevelChanged(level);
+    }
+
+    govStart_ = current;
+    govBusy_ = 0;
+    govPackets_ = 0;
+}
+
+void VideoDecodeThread::resetGovernor() {
+    govStart_ = now();
+    govBusy_ = 0;
+    govPackets_ = 0;
+    govHold_ = 0;
+}
+
+void VideoDecodeThread::applyDegradeLevel() {
+    if (!decCtx_) {
+        return;
+    }
+
+    const DegradeStep& step = DEGRADE_STEPS[degradeLevel_.load()];
+    decCtx_->skip_loop_filter = step.loopFilter;
+    decCtx_->skip_idct = step.idct;
+    if (seekTarget_ == AV_NOPTS_VALUE) {
+        decCtx_->skip_frame = step.frame;
+    }
+}
+
+AVDiscard VideoDecodeThread::skipFrameBase() const {
+    return DEGRADE_STEPS[degradeLevel_.load()].frame;
+}
+
+int64_t VideoDecodeThread::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void VideoDecodeThread::flushDecoder() {
@@ -221,14 +725,19 @@ void VideoDecodeThread::flushDecoder() {
     }
 }
 
+void VideoDecodeThread::park() {
+    QMutexLocker locker(&bindMutex_);
+    parked_ = true;
+    bindWc_.wakeAll();
+    while (running_.load() && !bound_.load()) {
+        bindWc_.wait(&bindMutex_);
+    }
+    parked_ = false;
+}
+
 void VideoDecodeThread::cleanup() {
     if (decFrm_) {
         av_frame_free(&decFrm_);
         decFrm_ = nullptr;
     }
-
-    if (yuvFrm_) {
-        av_frame_free(&yuvFrm_);
-        yuvFrm_ = nullptr;
-    }
 }
\ No newline at end of file
@@ -1,17 +1,30 @@
 #include "VideoPlayThread.h"
 
-VideoPlayThread::VideoPlayThread(QObject* parent, YUVRenderer* yuvRenderer, std::shared_ptr<MediaBuffer> buffer)
+VideoPlayThread::VideoPlayThread(QObject* parent, YUVRenderer* yuvRenderer)
     : QThread(parent)
     , yuvRenderer_(yuvRenderer)
-    , buffer_(buffer)
     , avsyncManager_(nullptr)
     , initError_("")
+    , bindError_("")
     , speed_(1.0f)
+    , serial_(0)
+    , ended_(false)
+    , parked_(false)
+    , pending_(nullptr)
+    , anchorTime_(0)
+    , anchorPts_(0.0)
     , inited_(false)
+    , bound_(false)
     , paused_(false)
     , running_(false)
     , started_(false)
-    , currentTime_(0.0) {
+    , firstFrame_(false)
+    , item_(0)
+    , currentTime_(0.0)
+    , onTimeFrames_(0)
+    , lateFrames_(0)
+    , droppedFrames_(0)
+    , reanchor_(true) {
 
     do {
         if (!yuvRenderer_) {
@@ -19,30 +32,110 @@ VideoPlayThread::VideoPlayThread(QObject* parent, YUVRenderer* yuvRenderer, std:
             break;
         }
 
-        if (!buffer_) {
-            initError_ = "Media Buffer is NULL";
+        inited_.store(true);
+
+    } while (0);
+}
+
+VideoPlayThread::~VideoPlayThread() {
+    stop();
+    unbind();
+}
+
+// The sync manager depends on the frame and sample durations of the media, it is the only
+// per-media state rebuilt here. Speed and pause state carry over.
+bool VideoPlayThread::bind(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    unbind();
+
+    do {
+        if (!context) {
+            bindError_ = "Media context is NULL";
             break;
         }
 
-        const media::VideoParams& vp = MCTX()->mediaInput()->videoParams();
-        const media::AudioParams& ap = MCTX()->mediaInput()->audioParams();
+        if (!buffer) {
+            bindError_ = "Media Buffer is NULL";
+            break;
+        }
+
+        const media::VideoParams& vp = context->mediaInput()->videoParams();
+        const media::AudioParams& ap = context->mediaInput()->audioParams();
 
         double vd = av_q2d(av_inv_q(vp.framerate));
         double ad = av_q2d(ap.timebase) * ap.framesize;
 
-        avsyncManager_ = std::make_unique<media::AVSyncManager>(vd, ad);
-        if (!avsyncManager_) {
-            initError_ = "AVSyncManager create failed";
+        auto avsyncManager = std::make_unique<media::AVSyncManager>(vd, ad);
+        if (!avsyncManager) {
+            bindError_ = "AVSyncManager create failed";
             break;
         }
 
-        inited_.store(true);
+        float speed;
+        {
+            QMutexLocker locker(&mutex_);
+            speed = speed_;
+        }
+
+        avsyncManager->setSpeed(static_cast<double>(speed));
+        if (paused_.load()) {
+            avsyncManager->pause();
+        }
+
+        QMutexLocker locker(&bindMutex_);
+        {
+            QMutexLocker sourceLocker(&mutex_);
+            context_ = std::move(context);
+            buffer_ = std::move(buffer);
+        }
+        avsyncManager_ = std::move(avsyncManager);
+        serial_ = buffer_->serial();
+        ended_ = false;
+        item_.store(buffer_->id());
+        firstFrame_.store(false);
+        currentTime_.store(0.0);
+        reanchor_.store(true);
+        resetFrameStats();
+
+        bound_.store(true);
+        bindWc_.wakeAll();
+        return true;
 
     } while (0);
+
+    return false;
 }
 
-VideoPlayThread::~VideoPlayThread() {
-    stop();
+void VideoPlayThread::unbind() {
+    bound_.store(false);
+    {
+        QMutexLocker locker(&pauseMutex_);
+        pauseWc_.wakeAll();
+    }
+
+    std::shared_ptr<MediaBuffer> buffer;
+    {
+        QMutexLocker locker(&mutex_);
+        buffer = buffer_;
+    }
+
+    if (buffer) {
+        buffer->wakeup();
+    }
+
+    QMutexLocker locker(&bindMutex_);
+    while (isRunning() && running_.load() && !parked_) {
+        bindWc_.wait(&bindMutex_);
+    }
+
+    QMutexLocker sourceLocker(&mutex_);
+    context_.reset();
+    buffer_.reset();
+    nextContext_.reset();
+    nextBuffer_.reset();
+}
+
+QString VideoPlayThread::bindError() const {
+    return bindError_;
 }
 
 void VideoPlayThread::start() {
@@ -51,6 +144,7 @@ void VideoPlayThread::start() {
     }
 
     if (!inited_.load()) {
+        started_.store(false);
         emit videoPlayError(initError_);
         return;
     }
@@ -71,6 +165,20 @@ void VideoPlayThread::stop() {
         QMutexLocker locker(&pauseMutex_);
         pauseWc_.wakeAll();
     }
+    {
+        QMutexLocker locker(&bindMutex_);
+        bindWc_.wakeAll();
+    }
+
+    std::shared_ptr<MediaBuffer> buffer;
+    {
+        QMutexLocker locker(&mutex_);
+        buffer = buffer_;
+    }
+
+    if (buffer) {
+        buffer->wakeup();
+    }
 
     if (!wait(3000)) {
         terminate();
@@ -89,6 +197,7 @@ void VideoPlayThread::pause() {
 }
 
 void VideoPlayThread::resume() {
+    reanchor_.store(true);
     paused_.store(false);
     {
         QMutexLocker locker(&pauseMutex_);
@@ -108,6 +217,7 @@ void VideoPlayThread::setSpeed(float speed) {
         }
         speed_ = speed;
     }
+    reanchor_.store(true);
 
     if (avsyncManager_) {
         avsyncManager_->setSpeed(static_cast<double>(speed));
@@ -118,62 +228,312 @@ double VideoPlayThread::getCurrentTime() const {
     return currentTime_.load();
 }
 
-void VideoPlayThread::onFlushRequest() {
-    if (avsyncManager_) {
-        avsyncManager_->reset();
-    }
+VideoPlayThread::FrameStats VideoPlayThread::frameStats() const {
+    return { onTimeFrames_.load(), lateFrames_.load(), droppedFrames_.load() };
 }
 
-void VideoPlayThread::onUpdateAudioClock(double pts, double duration) {
-    if (avsyncManager_) {
-        avsyncManager_->updateAudioClock(pts, duration);
+const media::FrameTimingHistogram& VideoPlayThread::frameTiming() const {
+    return timing_;
+}
+
+// The source switches after the current item's end of stream. The sync manager keeps
+// the frame and sample durations of the first item.
+// Wakes the run loop in case it already waits on the ended item.
+void VideoPlayThread::setNextSource(std::shared_ptr<MediaContext> context, std::shared_ptr<MediaBuffer> buffer) {
+    std::shared_ptr<MediaBuffer> current;
+    {
+        QMutexLocker locker(&mutex_);
+        nextContext_ = std::move(context);
+        nextBuffer_ = std::move(buffer);
+        current = buffer_;
+    }
+
+    if (current) {
+        current->wakeup();
     }
 }
 
+void VideoPlayThread::setAudioClock(std::shared_ptr<media::AudioClock> clock) {
+    audioClock_ = std::move(clock);
+}
+
 void VideoPlayThread::run() {
     running_.store(true);
 
     while (running_.load() && !isInterruptionRequested()) {
+        if (!bound_.load()) {
+            av_frame_free(&pending_);
+            park();
+            continue;
+        }
+
         if (paused_.load()) {
             QMutexLocker locker(&pauseMutex_);
-            if (running_.load()) {
-                pauseWc_.wait(&pauseMutex_, 50);
+            if (running_.load() && bound_.load() && paused_.load()) {
+                pauseWc_.wait(&pauseMutex_);
+            }
+            continue;
+        }
+
+        // The frame a pause interrupted is shown after the resume, unless a seek made it stale.
+        if (pending_) {
+            AVFrame* frame = pending_;
+            pending_ = nullptr;
+            if (media::itemSerial(frame) < buffer_->serial()) {
+                av_frame_free(&frame);
+            }
+            else {
+                presentFrame(frame);
             }
             continue;
         }
 
-        AVFrame* frame = reinterpret_cast<AVFrame*>(buffer_->dequeue<media::VIDEO, media::DECODING>());
+        if (ended_ && switchSource()) {
+            continue;
+        }
+
+        AVFrame* frame = buffer_->dequeue<media::VIDEO, media::DECODING>(media::MediaWait_Infinite);
         if (!frame) {
-            msleep(1);
             continue;
         }
 
-        int delay = processFrame(frame);
-        av_frame_free(&frame);
+        int64_t serial = media::itemSerial(frame);
+        if (serial < buffer_->serial()) {
+            av_frame_free(&frame);
+            continue;
+        }
+
+        if (serial != serial_) {
+            serial_ = serial;
+            ended_ = false;
+            reanchor_.store(true);
+            avsyncManager_->reset();
+        }
+
+        if (media::isEndOfStream(frame)) {
+            av_frame_free(&frame);
+            ended_ = true;
+            continue;
+        }
 
-        if (delay > 0) {
-            msleep(delay);
+        if (dropLateFrame(frame)) {
+            av_frame_free(&frame);
+            continue;
         }
+
+        presentFrame(frame);
     }
 
+    av_frame_free(&pending_);
     running_.store(false);
 }
 
-int VideoPlayThread::processFrame(AVFrame* frame) {
+bool VideoPlayThread::switchSource() {
+    {
+        QMutexLocker locker(&mutex_);
+        if (!nextBuffer_) {
+            return false;
+        }
+
+        context_ = std::move(nextContext_);
+        buffer_ = std::move(nextBuffer_);
+    }
+
+    serial_ = buffer_->serial();
+    ended_ = false;
+    item_.store(buffer_->id());
+    reanchor_.store(true);
+    avsyncManager_->reset();
+
+    emit sourceSwitched();
+    return true;
+}
+
+void VideoPlayThread::park() {
+    QMutexLocker locker(&bindMutex_);
+    parked_ = true;
+    bindWc_.wakeAll();
+    while (running_.load() && !bound_.load()) {
+        bindWc_.wait(&bindMutex_);
+    }
+    parked_ = false;
+}
+
+// Each frame is held back until its own absolute deadline and then shown. The sync
+// manager still sees every frame, its millisecond delay is no longer used for pacing.
+// Takes the frame, it is kept in pending_ when a pause interrupts the wait for its deadline.
+void VideoPlayThread::presentFrame(AVFrame* frame) {
+    if (!processFrame(frame) && paused_.load() && bound_.load() && running_.load() &&
+        serial_ >= buffer_->serial()) {
+        pending_ = frame;
+        return;
+    }
+
+    av_frame_free(&frame);
+}
+
+// False when the wait for the deadline was interrupted and the frame was not shown.
+bool VideoPlayThread::processFrame(AVFrame* frame) {
     if (!frame || !yuvRenderer_ || !avsyncManager_) {
-        return 0;
+        return true;
     }
 
     double pts = frame->pts * av_q2d(frame->time_base);
     double duration = frame->duration * av_q2d(frame->time_base);
 
+    // The sync manager is fed from this thread, with the audio clock extrapolated to now.
+    double audioClock = 0.0;
+    double audioDuration = 0.0;
+    if (masterClock(audioClock, &audioDuration)) {
+        avsyncManager_->updateAudioClock(audioClock, audioDuration);
+    }
+
     int delay = 0;
     avsyncManager_->updateVideoClock(pts, duration, delay);
 
+    const int64_t deadline = frameDeadline(pts);
+    if (!waitUntil(deadline)) {
+        return false;
+    }
+
+    double clock = 0.0;
+    if (masterClock(clock)) {
+        if (clock - pts > LATE_TOLERANCE) {
+            lateFrames_++;
+        }
+        else {
+            onTimeFrames_++;
+        }
+    }
+    else {
+        onTimeFrames_++;
+    }
+
+    timing_.add(now() - deadline);
     currentTime_.store(pts);
     yuvRenderer_->updateYUVFrame(frame->data[0], frame->data[1], frame->data[2],
                                  frame->width, frame->height,
                                  frame->linesize[0], frame->linesize[1], frame->linesize[2]);
 
-    return delay;
+    if (!firstFrame_.exchange(true)) {
+        emit firstFrame();
+    }
+
+    return true;
+}
+
+// Deadlines follow the frame pts from an anchor, so consecutive frames are spaced exactly
+// by their pts difference. The audio clock, which only arrives with every audio callback,
+// steers the anchor instead of setting each deadline directly.
+int64_t VideoPlayThread::frameDeadline(double pts) {
+    const int64_t current = now();
+
+    float speed;
+    {
+        QMutexLocker locker(&mutex_);
+        speed = speed_ > 0.0f ? speed_ : 1.0f;
+    }
+
+    int64_t deadline = current;
+    if (!reanchor_.exchange(false) && anchorTime_ > 0) {
+        deadline = anchorTime_ + static_cast<int64_t>((pts - anchorPts_) / speed * 1000000.0);
+    }
+
+    double clock = 0.0;
+    if (masterClock(clock)) {
+        int64_t synced = current + static_cast<int64_t>((pts - clock) / speed * 1000000.0);
+        int64_t drift = synced - deadline;
+        deadline += std::abs(drift) > RESYNC ? drift : drift / DRIFT_DIVISOR;
+    }
+
+    if (deadline < current - LATE_RESET || deadline > current + AHEAD_RESET) {
+        deadline = current;
+    }
+
+    anchorTime_ = deadline;
+    anchorPts_ = pts;
+    return deadline;
+}
+
+// Sleeps to an absolute steady clock time, the remaining sub-millisecond is spun so
+// scheduler wakeup latency does not land on the frame. Returns false when pause, seek,
+// unbind or stop interrupted the wait.
+bool VideoPlayThread::waitUntil(int64_t deadline) {
+    while (true) {
+        if (!running_.load() || !bound_.load() || paused_.load() || isInterruptionRequested() ||
+            serial_ < buffer_->serial()) {
+            return false;
+        }
+
+        const int64_t current = now();
+        if (deadline - current <= SPIN_WINDOW) {
+            break;
+        }
+
+        const int64_t wakeup = std::min(deadline - SPIN_WINDOW, current + SLEEP_SLICE);
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::microseconds(wakeup)));
+    }
+
+    while (now() < deadline) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+// Dropping every stale frame in a row, instead of showing each one, catches up within a
+// frame interval. The newest frame is always shown, so a decoder that cannot keep up still
+// gets pictures on screen.
+bool VideoPlayThread::dropLateFrame(const AVFrame* frame) {
+    if (!firstFrame_.load() || frame->pts == AV_NOPTS_VALUE) {
+        return false;
+    }
+
+    double clock = 0.0;
+    if (!masterClock(clock)) {
+        return false;
+    }
+
+    double end = (frame->pts + qMax<int64_t>(frame->duration, 0)) * av_q2d(frame->time_base);
+    if (clock - end <= DROP_TOLERANCE || buffer_->empty<media::VIDEO, media::DECODING>()) {
+        return false;
+    }
+
+    droppedFrames_++;
+    return true;
+}
+
+// The audio clock extrapolated to now. Only samples of the current item and seek
+// generation count. Video only media has no clock to fall behind.
+bool VideoPlayThread::masterClock(double& clock, double* duration) const {
+    media::AudioClock::Sample sample;
+    if (!audioClock_ || !audioClock_->read(sample)) {
+        return false;
+    }
+
+    if (sample.item != item_.load() || sample.serial != serial_) {
+        return false;
+    }
+
+    const int64_t age = now() - sample.stamp;
+    if (age < 0 || age > CLOCK_MAX_AGE) {
+        return false;
+    }
+
+    clock = sample.pts + age / 1000000.0 * sample.speed;
+    if (duration) {
+        *duration = sample.duration;
+    }
+    return true;
+}
+
+void VideoPlayThread::resetFrameStats() {
+    onTimeFrames_.store(0);
+    lateFrames_.store(0);
+    droppedFrames_.store(0);
+    timing_.reset();
+}
+
+int64_t VideoPlayThread::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
 }
\ No newline at end of file
@@ -4,11 +4,20 @@ VideoPlayer::VideoPlayer(QWidget* parent)
     : QMainWindow(parent)
     , ui(new VideoPlayerUi(this))
     , state(Idle)
+    , resumeState(Idle)
+    , pendingSeek(-1)
+    , seekTarget(0)
+    , pendingOpen(0)
     , filePath("")
     , networkUrl("")
+    , playlistIndex(0)
+    , playlistLoop(false)
+    , context(std::make_shared<MediaContext>())
     , buffer(std::make_shared<MediaBuffer>())
+    , audioClock(std::make_shared<media::AudioClock>())
     , progressTimer(nullptr)
     , demuxThread(nullptr)
+    , indexThread(nullptr)
     , videoDecoderThread(nullptr)
     , audioDecoderThread(nullptr)
     , videoPlayThread(nullptr)
@@ -20,6 +29,7 @@ VideoPlayer::VideoPlayer(QWidget* parent)
 
 VideoPlayer::~VideoPlayer() {
     cleanup();
+    destroyThreads();
 }
 
 void VideoPlayer::setupUi() {
@@ -35,66 +45,183 @@ void VideoPlayer::setupUi() {
 
 void VideoPlayer::setupConnections() {
     connect(ui, &VideoPlayerUi::loadLocalVideo, this, &VideoPlayer::onLoadLocalVideo);
+    connect(ui, &VideoPlayerUi::loadPlaylist, this, &VideoPlayer::onLoadPlaylist);
     connect(ui, &VideoPlayerUi::loadNetworkVideo, this, &VideoPlayer::onLoadNetworkVideo);
     connect(ui, &VideoPlayerUi::playRequest, this, &VideoPlayer::onPlayRequest);
     connect(ui, &VideoPlayerUi::pauseRequest, this, &VideoPlayer::onPauseRequest);
     connect(ui, &VideoPlayerUi::stopRequest, this, &VideoPlayer::onStopRequest);
     connect(ui, &VideoPlayerUi::seekRequest, this, &VideoPlayer::onSeekRequest);
+    connect(ui, &VideoPlayerUi::seekRelativeRequest, this, &VideoPlayer::onSeekRelativeRequest);
     connect(ui, &VideoPlayerUi::speedChanged, this, &VideoPlayer::onSpeedChanged);
     connect(ui, &VideoPlayerUi::volumeChanged, this, &VideoPlayer::onVolumeChanged);
+    connect(ui, &VideoPlayerUi::viewportResized, this, &VideoPlayer::onViewportResized);
 }
 
-void VideoPlayer::setupThreads() {
-    demuxThread = new DemuxThread(this, buffer);
-    progressTimer = new QTimer(this);
-    progressTimer->setInterval(500);
+// The pipeline threads are created on first use and then kept: every load only binds them
+// to the new context and buffer. Threads the media does not need stay parked.
+QString VideoPlayer::setupThreads() {
+    if (!progressTimer) {
+        progressTimer = new QTimer(this);
+        progressTimer->setInterval(500);
+        connect(progressTimer, &QTimer::timeout, this, &VideoPlayer::onUpdateProgress);
+    }
+
+    bool hasVideo = context->mediaInput()->hasVideoStream();
+    bool hasAudio = context->mediaInput()->hasAudioStream();
+
+    if (!demuxThread) {
+        demuxThread = createDemuxThread();
+    }
+
+    if (hasVideo) {
+        if (!videoDecoderThread) {
+            videoDecoderThread = createVideoDecodeThread();
+        }
+
+        if (!videoPlayThread) {
+            videoPlayThread = new VideoPlayThread(this, ui->getVideoRenderer());
+            connect(videoPlayThread, &VideoPlayThread::videoPlayError, this, &VideoPlayer::onErrorOccurred);
+            connect(videoPlayThread, &VideoPlayThread::firstFrame, this, &VideoPlayer::onFirstFrame);
+            connect(videoPlayThread, &VideoPlayThread::sourceSwitched, this, &VideoPlayer::onSourceSwitched);
+            videoPlayThread->setAudioClock(audioClock);
+        }
+    }
+
+    if (hasAudio) {
+        if (!audioDecoderThread) {
+            audioDecoderThread = createAudioDecodeThread();
+        }
+
+        // The device keeps the samplerate of the first media with audio, later media are
+        // opened with it as output samplerate. Only a mismatch reopens the device.
+        if (audioPlayThread && audioPlayThread->sampleRate() != context->outputSampleRate()) {
+            cleanupThread(audioPlayThread);
+            audioPlayThread = nullptr;
+        }
+
+        if (!audioPlayThread) {
+            audioPlayThread = new AudioPlayThread(this, context->outputSampleRate());
+            connect(audioPlayThread, &AudioPlayThread::audioPlayError, this, &VideoPlayer::onErrorOccurred);
+            connect(audioPlayThread, &AudioPlayThread::sourceSwitched, this, &VideoPlayer::onSourceSwitched);
+            connect(audioPlayThread, &AudioPlayThread::firstFrame, this, [this]() {
+                if (!context->mediaInput()->hasVideoStream()) {
+                    onFirstFrame();
+                }
+                });
+            audioPlayThread->setAudioClock(audioClock);
+        }
+    }
+
+    if (!demuxThread->bind(context, buffer)) {
+        return demuxThread->bindError();
+    }
 
     int volume = ui->getVolume();
-    float speed = MCTX()->mediaInput()->duration() <= 0 ? 1.0f : ui->getSpeed();
+    float speed = context->mediaInput()->duration() <= 0 ? 1.0f : ui->getSpeed();
+
+    if (hasVideo) {
+        if (!videoDecoderThread->bind(context, buffer)) {
+            return videoDecoderThread->bindError();
+        }
+        videoDecoderThread->setSpeed(speed);
 
-    if (MCTX()->mediaInput()->hasVideoStream()) {
-        videoDecoderThread = new VideoDecodeThread(this, buffer);
-        videoPlayThread = new VideoPlayThread(this, ui->getVideoRenderer(), buffer);
+        if (!videoPlayThread->bind(context, buffer)) {
+            return videoPlayThread->bindError();
+        }
         videoPlayThread->setSpeed(speed);
     }
 
-    if (MCTX()->mediaInput()->hasAudioStream()) {
-        audioDecoderThread = new AudioDecodeThread(this, buffer);
-        audioPlayThread = new AudioPlayThread(this, buffer);
+    if (hasAudio) {
+        if (!audioDecoderThread->bind(context, buffer)) {
+            return audioDecoderThread->bindError();
+        }
+
+        if (!audioPlayThread->bind(context, buffer)) {
+            return audioPlayThread->bindError();
+        }
         audioPlayThread->setVolume(volume);
         audioPlayThread->setSpeed(speed);
     }
 
-    setupThreadConnections();
+    return QString();
 }
 
-void VideoPlayer::setupThreadConnections() {
-    connect(demuxThread, &DemuxThread::demuxError, this, &VideoPlayer::onErrorOccurred);
-    connect(progressTimer, &QTimer::timeout, this, &VideoPlayer::onUpdateProgress);
+// Demux and decode threads start right away and park until they are bound.
+DemuxThread* VideoPlayer::createDemuxThread() {
+    DemuxThread* thread = new DemuxThread(this);
+    thread->setAccurateSeek(true);
+    connect(thread, &DemuxThread::demuxError, this, &VideoPlayer::onErrorOccurred);
+    connect(thread, &DemuxThread::seekFinished, this, &VideoPlayer::onSeekFinished);
+    thread->start();
+    return thread;
+}
 
-    if (videoDecoderThread) {
-        connect(videoDecoderThread, &VideoDecodeThread::videoDecodeError, this, &VideoPlayer::onErrorOccurred);
-        connect(demuxThread, &DemuxThread::flushRequest, videoDecoderThread, &VideoDecodeThread::onFlushRequest);
+VideoDecodeThread* VideoPlayer::createVideoDecodeThread() {
+    VideoDecodeThread* thread = new VideoDecodeThread(this);
+    connect(thread, &VideoDecodeThread::videoDecodeError, this, &VideoPlayer::onErrorOccurred);
+    connect(thread, &VideoDecodeThread::seekReached, this, &VideoPlayer::onSeekReached);
+    connect(thread, &VideoDecodeThread::frameConverted, this, &VideoPlayer::onFrameConverted);
+    connect(thread, &VideoDecodeThread::degradeLevelChanged, this, &VideoPlayer::onDegradeLevelChanged);
+    const QSize viewport = ui->getViewportSize();
+    thread->setOutputSize(viewport.width(), viewport.height());
+    thread->start();
+    return thread;
+}
+
+AudioDecodeThread* VideoPlayer::createAudioDecodeThread() {
+    AudioDecodeThread* thread = new AudioDecodeThread(this);
+    connect(thread, &AudioDecodeThread::audioDecodeError, this, &VideoPlayer::onErrorOccurred);
+    connect(thread, &AudioDecodeThread::seekReached, this, [this](qint64 elapsed) {
+        if (!context->mediaInput()->hasVideoStream()) {
+            onSeekReached(elapsed);
+        }
+        });
+    thread->start();
+    return thread;
+}
+
+int64_t VideoPlayer::totalDuration() const {
+    AVFormatContext* inputCtx = context->mediaInput()->inputContext();
+    if (inputCtx && inputCtx->duration > 0 && inputCtx->duration != AV_NOPTS_VALUE) {
+        return inputCtx->duration;
     }
 
-    if (videoPlayThread) {
-        connect(videoPlayThread, &VideoPlayThread::videoPlayError, this, &VideoPlayer::onErrorOccurred);
-        connect(demuxThread, &DemuxThread::flushRequest, videoPlayThread, &VideoPlayThread::onFlushRequest);
+    int64_t seconds = context->mediaInput()->duration();
+    return seconds > 0 ? seconds * AV_TIME_BASE : 0;
+}
+
+// The play clocks run on the stream timeline; positions shown and sought by the UI count
+// from the start of the media, so the container's start_time is taken off here.
+int64_t VideoPlayer::currentPosition() const {
+    double currentTime = 0.0;
+    if (videoPlayThread && context->mediaInput()->hasVideoStream()) {
+        currentTime = videoPlayThread->getCurrentTime();
+    }
+    else if (audioPlayThread) {
+        currentTime = audioPlayThread->getCurrentTime();
     }
 
-    if (audioDecoderThread) {
-        connect(audioDecoderThread, &AudioDecodeThread::audioDecodeError, this, &VideoPlayer::onErrorOccurred);
-        connect(demuxThread, &DemuxThread::flushRequest, audioDecoderThread, &AudioDecodeThread::onFlushRequest);
+    if (currentTime <= 0.0) {
+        return 0;
     }
 
-    if (audioPlayThread) {
-        connect(audioPlayThread, &AudioPlayThread::audioPlayError, this, &VideoPlayer::onErrorOccurred);
-        connect(demuxThread, &DemuxThread::flushRequest, audioPlayThread, &AudioPlayThread::onFlushStream);
+    int64_t position = static_cast<int64_t>(currentTime * AV_TIME_BASE);
+    AVFormatContext* inputCtx = context->mediaInput()->inputContext();
+    if (inputCtx && inputCtx->start_time != AV_NOPTS_VALUE) {
+        position -= inputCtx->start_time;
     }
 
-    if (audioPlayThread && videoPlayThread) {
-        connect(audioPlayThread, &AudioPlayThread::updateAudioClock, videoPlayThread, &VideoPlayThread::onUpdateAudioClock);
+    return std::max<int64_t>(position, 0);
+}
+
+void VideoPlayer::setupIndexThread(const QString& filePath) {
+    if (!context->mediaInput()->hasVideoStream()) {
+        return;
     }
+
+    indexThread = new KeyframeIndexThread(this, filePath, context->mediaInput()->videoParams().index);
+    connect(indexThread, &KeyframeIndexThread::indexReady, this, &VideoPlayer::onIndexReady);
+    indexThread->start();
 }
 
 void VideoPlayer::handleError(const QString& error) {
@@ -111,31 +238,91 @@ void VideoPlayer::showErrorMessage(const QString& error) {
     }
 }
 
+// Releases the media but keeps the pipeline threads, they are only unbound and parked.
 void VideoPlayer::cleanup() {
+    context->cancelOpen();
     buffer->lock();
 
+    if (progressTimer) {
+        progressTimer->stop();
+    }
+
+    cleanupThread(indexThread);
+    indexThread = nullptr;
+
+    if (videoPlayThread) {
+        VideoPlayThread::FrameStats stats = videoPlayThread->frameStats();
+        if (stats.onTime + stats.late + stats.dropped > 0) {
+            qInfo("Video frames: %llu on time, %llu late, %llu dropped",
+                  static_cast<unsigned long long>(stats.onTime),
+                  static_cast<unsigned long long>(stats.late),
+                  static_cast<unsigned long long>(stats.dropped));
+        }
+
+        const media::FrameTimingHistogram& timing = videoPlayThread->frameTiming();
+        if (timing.total() > 0) {
+            qInfo("Video frame timing error: %s", timing.toString().c_str());
+        }
+
+        videoPlayThread->pause();
+        videoPlayThread->unbind();
+    }
+
+    media::MediaPoolStats packets = buffer->packetPoolStats();
+    if (packets.hits + packets.misses > 0) {
+        qInfo("Packet pool: %llu hits, %llu misses (%.1f%% reused)",
+              static_cast<unsigned long long>(packets.hits),
+              static_cast<unsigned long long>(packets.misses),
+              100.0 * packets.hits / (packets.hits + packets.misses));
+    }
+
+    if (audioPlayThread) {
+        if (audioPlayThread->underruns() > 0) {
+            qInfo("Audio underruns: %llu", static_cast<unsigned long long>(audioPlayThread->underruns()));
+        }
+
+        audioPlayThread->pause();
+        audioPlayThread->unbind();
+    }
+
+    if (demuxThread) demuxThread->unbind();
+    if (videoDecoderThread) videoDecoderThread->unbind();
+    if (audioDecoderThread) audioDecoderThread->unbind();
+
+    cleanupNext();
+    context->reset();
+
+    buffer->clear();
+    buffer->unlock();
+    buffer = std::make_shared<MediaBuffer>();
+}
+
+void VideoPlayer::destroyThreads() {
     if (progressTimer) {
         progressTimer->stop();
         delete progressTimer;
         progressTimer = nullptr;
     }
 
+    cleanupThread(indexThread);
     cleanupThread(demuxThread);
     cleanupThread(videoDecoderThread);
     cleanupThread(audioDecoderThread);
+    cleanupThread(next.demuxThread);
+    cleanupThread(next.videoDecoderThread);
+    cleanupThread(next.audioDecoderThread);
     cleanupThread(videoPlayThread);
     cleanupThread(audioPlayThread);
 
+    indexThread = nullptr;
     demuxThread = nullptr;
     videoDecoderThread = nullptr;
     audioDecoderThread = nullptr;
+    next.demuxThread = nullptr;
+    next.videoDecoderThread = nullptr;
+    next.audioDecoderThread = nullptr;
     videoPlayThread = nullptr;
     audioPlayThread = nullptr;
-
-    MCTX()->reset();
-
-    buffer->clear();
-    buffer->unlock();
 }
 
 void VideoPlayer::cleanupThread(QThread* thread) {
@@ -143,7 +330,10 @@ void VideoPlayer::cleanupThread(QThread* thread) {
         return;
     }
 
-    if (auto* demux = dynamic_cast<DemuxThread*>(thread)) {
+    if (auto* index = dynamic_cast<KeyframeIndexThread*>(thread)) {
+        index->stop();
+    }
+    else if (auto* demux = dynamic_cast<DemuxThread*>(thread)) {
         demux->stop();
     }
     else if (auto* videoDec = dynamic_cast<VideoDecodeThread*>(thread)) {
@@ -174,80 +364,150 @@ void VideoPlayer::cleanupThread(QThread* thread) {
 }
 
 void VideoPlayer::onLoadLocalVideo(const QString& filePath) {
-    if (state == Loading) {
+    if (filePath.isEmpty()) {
+        handleError("File path cannot be empty");
         return;
     }
 
-    state = Loading;
+    playlist.clear();
+    openMedia(filePath, false);
+}
 
-    if (filePath.isEmpty()) {
-        handleError("File path cannot be empty");
+void VideoPlayer::onLoadPlaylist(const QStringList& files) {
+    playPlaylist(files, false);
+}
+
+void VideoPlayer::onLoadNetworkVideo(const QString& networkUrl) {
+    if (networkUrl.isEmpty()) {
+        handleError("Network URL cannot be empty");
         return;
     }
 
+    playlist.clear();
+    openMedia(networkUrl, true);
+}
+
+// Local files only. With loop the playlist starts over after its last item, a single file
+// loop included.
+void VideoPlayer::playPlaylist(const QStringList& files, bool loop) {
+    if (files.isEmpty()) {
+        handleError("Playlist cannot be empty");
+        return;
+    }
+
+    playlist = files;
+    playlistIndex = 0;
+    playlistLoop = loop;
+    openMedia(playlist.at(0), false);
+}
+
+// Used by the next open. A running decoder keeps its threads until it is reopened.
+void VideoPlayer::setDecodeThreading(const media::DecodeThreadPolicy& policy) {
+    decodeThreading = policy;
+}
+
+// A load issued while another one is still opening cancels it through cleanup().
+void VideoPlayer::openMedia(const QString& url, bool network) {
     if (!buffer) {
         handleError("Media buffer cannot be nullptr");
         return;
     }
 
+    // Switch latency: from here, through releasing the previous media, to the first frame.
+    loadTimer.start();
     cleanup();
     ui->resetUiState();
 
-    int ret = MCTX()->playFileStream(filePath.toStdString());
-    if (ret < 0) {
-        handleError(QString(MCTX()->error().c_str()));
+    state = Loading;
+    setWindowTitle("Video Player - Loading...");
+
+    context->setOutputSampleRate(audioPlayThread ? audioPlayThread->sampleRate() : 0);
+    context->setDecodeThreading(decodeThreading);
+    pendingOpen = context->openAsync(url.toStdString(), network,
+        [this](uint64_t id, MediaContext::OpenStage stage, int64_t elapsed) {
+            QMetaObject::invokeMethod(this, [this, id, stage, elapsed]() {
+                onOpenStage(id, static_cast<int>(stage), elapsed);
+                }, Qt::QueuedConnection);
+        },
+        [this, url, network](uint64_t id, int ret, const std::string& error) {
+            QString message = QString::fromStdString(error);
+            QMetaObject::invokeMethod(this, [this, id, ret, message, url, network]() {
+                onOpenFinished(id, ret, message, url, network);
+                }, Qt::QueuedConnection);
+        });
+}
+
+void VideoPlayer::onOpenStage(uint64_t id, int stage, int64_t elapsed) {
+    if (id != pendingOpen || state != Loading) {
         return;
     }
 
-    int64_t totalTime = MCTX()->mediaInput()->duration();
-    if (totalTime <= 0 || totalTime == AV_NOPTS_VALUE) {
-        handleError("Invalid total time");
-        return;
+    static const char* const names[] = { "open input", "open decoder", "open resampler" };
+    if (stage >= 0 && stage < static_cast<int>(sizeof(names) / sizeof(names[0]))) {
+        qInfo("Open stage %s took %.1f ms", names[stage], elapsed / 1000.0);
     }
+}
 
-    ui->setTotalTime(totalTime);
+void VideoPlayer::onOpenFinished(uint64_t id, int ret, const QString& error, const QString& url, bool network) {
+    if (id != pendingOpen || state != Loading) {
+        return;
+    }
 
-    this->filePath = filePath;
-    setWindowTitle(QString("Video Player - %1").arg(QFileInfo(filePath).fileName()));
-    setupThreads();
+    if (ret < 0) {
+        handleError(error);
+        return;
+    }
 
-    state = Loaded;
-    QTimer::singleShot(50, this, [this]() {
-        if (state == Loaded) {
-            onPlayRequest();
-        }
-        });
+    if (network) {
+        finishNetworkLoad(url);
+    }
+    else {
+        finishLocalLoad(url);
+    }
 }
 
-void VideoPlayer::onLoadNetworkVideo(const QString& networkUrl) {
-    if (state == Loading) {
+void VideoPlayer::onFirstFrame() {
+    if (!loadTimer.isValid()) {
         return;
     }
 
-    state = Loading;
+    qInfo("Switch to first frame took %lld ms", static_cast<long long>(loadTimer.elapsed()));
+    loadTimer.invalidate();
+}
 
-    if (networkUrl.isEmpty()) {
-        handleError("Network URL cannot be empty");
+void VideoPlayer::finishLocalLoad(const QString& filePath) {
+    int64_t totalTime = totalDuration();
+    if (totalTime <= 0) {
+        handleError("Invalid total time");
         return;
     }
 
-    if (!buffer) {
-        handleError("Media buffer cannot be nullptr");
-        return;
-    }
+    ui->setTotalTime(totalTime);
 
-    cleanup();
-    ui->resetUiState();
+    this->filePath = filePath;
+    setWindowTitle(QString("Video Player - %1").arg(QFileInfo(filePath).fileName()));
 
-    int ret = MCTX()->playNetworkStream(networkUrl.toStdString());
-    if (ret < 0) {
-        handleError(QString(MCTX()->error().c_str()));
+    QString error = setupThreads();
+    if (!error.isEmpty()) {
+        handleError(error);
         return;
     }
 
-    if (MCTX()->mediaInput()->duration() > 0) {
-        int64_t totalTime = MCTX()->mediaInput()->duration();
-        if (totalTime <= 0 || totalTime == AV_NOPTS_VALUE) {
+    setupIndexThread(filePath);
+    prepareNext();
+
+    state = Loaded;
+    QTimer::singleShot(0, this, [this]() {
+        if (state == Loaded) {
+            onPlayRequest();
+        }
+        });
+}
+
+void VideoPlayer::finishNetworkLoad(const QString& networkUrl) {
+    if (context->mediaInput()->duration() > 0) {
+        int64_t totalTime = totalDuration();
+        if (totalTime <= 0) {
             handleError("Invalid total time for VOD stream");
             return;
         }
@@ -262,16 +522,182 @@ void VideoPlayer::onLoadNetworkVideo(const QString& networkUrl) {
     }
 
     this->networkUrl = networkUrl;
-    setupThreads();
+
+    QString error = setupThreads();
+    if (!error.isEmpty()) {
+        handleError(error);
+        return;
+    }
 
     state = Loaded;
-    QTimer::singleShot(50, this, [this]() {
+    QTimer::singleShot(0, this, [this]() {
         if (state == Loaded) {
             onPlayRequest();
         }
         });
 }
 
+int VideoPlayer::nextPlaylistIndex() const {
+    if (playlist.isEmpty()) {
+        return -1;
+    }
+
+    int index = playlistIndex + 1;
+    if (index < playlist.size()) {
+        return index;
+    }
+
+    return playlistLoop ? 0 : -1;
+}
+
+void VideoPlayer::prepareNext() {
+    int index = nextPlaylistIndex();
+    if (index < 0) {
+        return;
+    }
+
+    next.index = index;
+    next.context = std::make_shared<MediaContext>();
+    next.context->setOutputSampleRate(audioPlayThread ? audioPlayThread->sampleRate() : 0);
+    next.context->setDecodeThreading(decodeThreading);
+    next.openId = next.context->openAsync(playlist.at(index).toStdString(), false, nullptr,
+        [this](uint64_t id, int ret, const std::string& error) {
+            QString message = QString::fromStdString(error);
+            QMetaObject::invokeMethod(this, [this, id, ret, message]() {
+                onNextOpened(id, ret, message);
+                }, Qt::QueuedConnection);
+        });
+}
+
+// A next item with different streams than the current one cannot take over the running
+// play threads, it is loaded the regular way once the current item has finished.
+void VideoPlayer::onNextOpened(uint64_t id, int ret, const QString& error) {
+    if (!next.context || id != next.openId) {
+        return;
+    }
+
+    if (ret < 0) {
+        qWarning("Prepare next playlist item failed: %s", qPrintable(error));
+        cleanupNext();
+        return;
+    }
+
+    media::MediaInput* input = next.context->mediaInput();
+    media::MediaInput* current = context->mediaInput();
+    if (input->hasVideoStream() != current->hasVideoStream() ||
+        input->hasAudioStream() != current->hasAudioStream() ||
+        input->duration() <= 0) {
+        cleanupNext();
+        return;
+    }
+
+    // The second set of demux and decode threads alternates with the current one.
+    if (!next.demuxThread) {
+        next.demuxThread = createDemuxThread();
+    }
+    if (input->hasVideoStream() && !next.videoDecoderThread) {
+        next.videoDecoderThread = createVideoDecodeThread();
+    }
+    if (input->hasAudioStream() && !next.audioDecoderThread) {
+        next.audioDecoderThread = createAudioDecodeThread();
+    }
+
+    // Demuxing and decoding start right away, the bounded queues hold the first frames
+    // ready for the switch.
+    next.buffer = std::make_shared<MediaBuffer>();
+    bool ok = next.demuxThread->bind(next.context, next.buffer);
+    if (ok && input->hasVideoStream()) {
+        ok = next.videoDecoderThread->bind(next.context, next.buffer);
+        next.videoDecoderThread->setSpeed(ui->getSpeed());
+    }
+    if (ok && input->hasAudioStream()) {
+        ok = next.audioDecoderThread->bind(next.context, next.buffer);
+    }
+
+    if (!ok) {
+        qWarning("Prepare next playlist item failed");
+        cleanupNext();
+        return;
+    }
+
+    if (input->hasVideoStream()) videoPlayThread->setNextSource(next.context, next.buffer);
+    if (input->hasAudioStream()) audioPlayThread->setNextSource(next.context, next.buffer);
+}
+
+void VideoPlayer::onSourceSwitched() {
+    if (!next.buffer) {
+        return;
+    }
+
+    int threads = (context->mediaInput()->hasVideoStream() ? 1 : 0) + (context->mediaInput()->hasAudioStream() ? 1 : 0);
+    if (++next.switched >= threads) {
+        promoteNext();
+    }
+}
+
+// Every play thread runs on the next item now. The finished item's demux and decode
+// threads are unbound and become the spare set for the item after.
+void VideoPlayer::promoteNext() {
+    cleanupThread(indexThread);
+    indexThread = nullptr;
+
+    if (demuxThread) demuxThread->unbind();
+    if (videoDecoderThread) videoDecoderThread->unbind();
+    if (audioDecoderThread) audioDecoderThread->unbind();
+
+    std::swap(demuxThread, next.demuxThread);
+    std::swap(videoDecoderThread, next.videoDecoderThread);
+    std::swap(audioDecoderThread, next.audioDecoderThread);
+
+    context = std::move(next.context);
+    buffer = std::move(next.buffer);
+    playlistIndex = next.index;
+    resetNext();
+
+    pendingSeek = -1;
+    filePath = playlist.at(playlistIndex);
+    ui->setTotalTime(totalDuration());
+    ui->setCurrentTime(0);
+    setWindowTitle(QString("Video Player - %1").arg(QFileInfo(filePath).fileName()));
+    setupIndexThread(filePath);
+
+    prepareNext();
+}
+
+// Safe only while no play thread has switched to the next item yet.
+void VideoPlayer::cleanupNext() {
+    if (videoPlayThread) videoPlayThread->setNextSource(nullptr, nullptr);
+    if (audioPlayThread) audioPlayThread->setNextSource(nullptr, nullptr);
+
+    if (next.context) {
+        next.context->cancelOpen();
+    }
+
+    if (next.buffer) {
+        next.buffer->lock();
+    }
+
+    if (next.demuxThread) next.demuxThread->unbind();
+    if (next.videoDecoderThread) next.videoDecoderThread->unbind();
+    if (next.audioDecoderThread) next.audioDecoderThread->unbind();
+
+    if (next.buffer) {
+        next.buffer->clear();
+        next.buffer->unlock();
+    }
+
+    resetNext();
+}
+
+// Keeps the spare threads.
+void VideoPlayer::resetNext() {
+    next.index = -1;
+    next.openId = 0;
+    next.switched = 0;
+    next.context.reset();
+    next.buffer.reset();
+}
+
 void VideoPlayer::onPlayRequest() {
     if (state == Idle || state == Loading || state == Playing) {
         return;
@@ -280,11 +706,14 @@ void VideoPlayer::onPlayRequest() {
     ui->setPlay(true);
 
     if (state == Loaded) {
-        if (videoPlayThread) videoPlayThread->start();
-        if (audioPlayThread) audioPlayThread->start();
-        if (videoDecoderThread) videoDecoderThread->start();
-        if (audioDecoderThread) audioDecoderThread->start();
-        if (demuxThread) demuxThread->start();
+        if (videoPlayThread) {
+            videoPlayThread->start();
+            videoPlayThread->resume();
+        }
+        if (audioPlayThread) {
+            audioPlayThread->start();
+            audioPlayThread->resume();
+        }
     }
     else if (state == Paused || state == Seeking || state == Finished) {
         if (videoPlayThread) videoPlayThread->resume();
@@ -303,17 +732,15 @@ void VideoPlayer::onPauseRequest() {
 
     ui->setPlay(false);
 
-    buffer->lock();
     if (videoPlayThread) videoPlayThread->pause();
     if (audioPlayThread) audioPlayThread->pause();
-    buffer->unlock();
     if (progressTimer) progressTimer->stop();
 
     state = Paused;
 }
 
 void VideoPlayer::onStopRequest() {
-    if (state == Idle || state == Loading) {
+    if (state == Idle) {
         return;
     }
 
@@ -323,64 +750,108 @@ void VideoPlayer::onStopRequest() {
     state = Idle;
 }
 
-void VideoPlayer::onSeekRequest(int position) {
-    if (MCTX()->mediaInput()->duration() <= 0) {
+void VideoPlayer::onSeekRequest(int64_t timestamp) {
+    if (state == Idle || state == Loading || state == Loaded) {
         return;
     }
 
-    if (state == Idle || state == Loading || state == Loaded) {
+    // Between the switches of the video and the audio play thread the items are mixed.
+    if (next.switched > 0) {
         return;
     }
 
-    if (state == Seeking) {
+    if (context->mediaInput()->duration() <= 0) {
         return;
     }
 
-    PlayState oldState = state;
-    state = Seeking;
+    int64_t totalTime = totalDuration();
+    if (totalTime <= 0 || !demuxThread) {
+        return;
+    }
 
-    buffer->lock();
-    if (videoPlayThread) videoPlayThread->pause();
-    if (audioPlayThread) audioPlayThread->pause();
-    buffer->unlock();
-    if (progressTimer) progressTimer->stop();
+    // While a seek is in flight newer targets simply replace it in DemuxThread.
+    if (state != Seeking) {
+        resumeState = state;
+        state = Seeking;
 
-    int64_t totalTime = MCTX()->mediaInput()->duration();
-    if (totalTime <= 0) {
-        state = oldState;
-        if (oldState == Playing) {
+        if (videoPlayThread) videoPlayThread->pause();
+        if (audioPlayThread) audioPlayThread->pause();
+        if (progressTimer) progressTimer->stop();
+    }
+
+    seekTarget = qBound(static_cast<int64_t>(0), timestamp, totalTime);
+    pendingSeek = demuxThread->seek(seekTarget);
+    if (pendingSeek < 0) {
+        state = resumeState;
+        if (resumeState == Playing) {
             if (videoPlayThread) videoPlayThread->resume();
             if (audioPlayThread) audioPlayThread->resume();
             if (progressTimer) progressTimer->start();
         }
+    }
+}
+
+// Repeated relative seeks accumulate on the pending target instead of the stale clock.
+void VideoPlayer::onSeekRelativeRequest(int64_t offset) {
+    if (state == Idle || state == Loading || state == Loaded) {
         return;
     }
 
-    position = qBound(0, position, 100);
-    int64_t targetTime = (static_cast<int64_t>(position) * totalTime + 50) / 100;
+    int64_t base = (state == Seeking) ? seekTarget : currentPosition();
+    onSeekRequest(base + offset);
+}
 
-    if (demuxThread) {
-        demuxThread->seek(targetTime);
+void VideoPlayer::onSeekFinished(qint64 request) {
+    if (request != pendingSeek) {
+        return;
     }
 
-    QTimer::singleShot(100, this, [this, oldState]() {
-        if (state == Seeking) {
-            if (oldState == Playing) {
-                onPlayRequest();
-            }
-            else {
-                state = oldState;
-            }
+    if (state == Seeking) {
+        if (resumeState == Playing) {
+            onPlayRequest();
         }
-        });
+        else {
+            state = resumeState;
+        }
+    }
+    else if (state == Finished) {
+        ui->setCurrentTime(0);
+        state = Paused;
+    }
+}
+
+void VideoPlayer::onSeekReached(qint64 elapsed) {
+    qInfo("Accurate seek reached its target in %.1f ms", elapsed / 1000.0);
+}
+
+void VideoPlayer::onFrameConverted(qint64 elapsed) {
+    convertStats.frames++;
+    convertStats.total += elapsed;
+    convertStats.max = qMax(convertStats.max, static_cast<int64_t>(elapsed));
+
+    if (convertStats.frames >= CONVERT_REPORT_FRAMES) {
+        qInfo("Pixel format conversion took %.2f ms per frame, %.2f ms max",
+              convertStats.total / 1000.0 / convertStats.frames, convertStats.max / 1000.0);
+        convertStats = ConvertStats();
+    }
+}
+
+void VideoPlayer::onDegradeLevelChanged(int level) {
+    qInfo("Video decode degrade level %d", level);
+}
+
+void VideoPlayer::onIndexReady() {
+    if (indexThread && demuxThread) {
+        demuxThread->setKeyframeIndex(indexThread->index());
+    }
 }
 
 void VideoPlayer::onSpeedChanged(float speed) {
-    if (MCTX()->mediaInput()->duration() <= 0) {
+    if (state == Idle || state == Loading) {
         return;
     }
 
-    if (state == Idle || state == Loading) {
+    if (context->mediaInput()->duration() <= 0) {
         return;
     }
 
@@ -388,6 +859,7 @@ void VideoPlayer::onSpeedChanged(float speed) {
         return;
     }
 
+    if (videoDecoderThread) videoDecoderThread->setSpeed(speed);
     if (videoPlayThread) videoPlayThread->setSpeed(speed);
     if (audioPlayThread) audioPlayThread->setSpeed(speed);
 }
@@ -404,30 +876,29 @@ void VideoPlayer::onVolumeChanged(int volume) {
     }
 }
 
+// Both decode thread sets follow the viewport, the spare one decodes the next item.
+void VideoPlayer::onViewportResized(const QSize& size) {
+    if (videoDecoderThread) videoDecoderThread->setOutputSize(size.width(), size.height());
+    if (next.videoDecoderThread) next.videoDecoderThread->setOutputSize(size.width(), size.height());
+}
+
 void VideoPlayer::onUpdateProgress() {
     if (state != Playing) {
         return;
     }
 
-    double currentTime = 0.0;
-    if (videoPlayThread) {
-        currentTime = videoPlayThread->getCurrentTime();
-    }
-    else if (audioPlayThread) {
-        currentTime = audioPlayThread->getCurrentTime();
-    }
+    int64_t currentTime = currentPosition();
+    ui->setCurrentTime(currentTime);
 
-    if (currentTime <= 0.0) {
-        currentTime = 0.0;
+    // With a prepared next item the end of stream drives the transition instead.
+    if (next.context) {
+        return;
     }
 
-    ui->setCurrentTime(static_cast<int64_t>(currentTime));
-
-    if (MCTX()->mediaInput()->duration() > 0) {
+    if (context->mediaInput()->duration() > 0) {
         int64_t totalTime = ui->getTotalTime();
         if (totalTime > 0) {
-            int64_t currentTimeSec = static_cast<int64_t>(currentTime);
-            if (currentTimeSec >= totalTime - 1) {
+            if (currentTime >= totalTime - AV_TIME_BASE) {
                 if (state == Playing) {
                     state = Finished;
                     QTimer::singleShot(1000, this, [this]() {
@@ -446,24 +917,35 @@ void VideoPlayer::onPlaybackFinished() {
         return;
     }
 
-    buffer->lock();
+    int index = nextPlaylistIndex();
+    if (index >= 0) {
+        playlistIndex = index;
+        openMedia(playlist.at(index), false);
+        return;
+    }
+
     if (videoPlayThread) videoPlayThread->pause();
     if (audioPlayThread) audioPlayThread->pause();
-    buffer->unlock();
     if (progressTimer) progressTimer->stop();
-    if (demuxThread) demuxThread->seek(0);
+    if (demuxThread) pendingSeek = demuxThread->seek(0);
 
     ui->setPlay(false);
-
-    QTimer::singleShot(100, this, [this]() {
-        if (state == Finished) {
-            ui->setCurrentTime(0);
-            state = Paused;
-        }
-        });
 }
 
+// An error of the spare thread set only concerns the item it pre-rolls, as long as no play
+// thread has switched to it yet. That item is dropped and opened the regular way once the
+// current one has finished.
 void VideoPlayer::onErrorOccurred(const QString& errorMsg) {
+    QObject* source = sender();
+    if (source && next.switched == 0 &&
+        (source == next.demuxThread || source == next.videoDecoderThread || source == next.audioDecoderThread)) {
+        if (next.context) {
+            qWarning("Next playlist item failed: %s", qPrintable(errorMsg));
+            cleanupNext();
+        }
+        return;
+    }
+
     if (state != Idle) {
         handleError(errorMsg);
     }
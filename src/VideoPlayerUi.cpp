@@ -44,8 +44,7 @@ void VideoPlayerUi::setCurrentTime(int64_t currentTime) {
         this->currentTime = currentTime;
         updateTimeLabel();
         if (totalTime > 0) {
-            int newProgress = qBound(0, static_cast<int>((currentTime * 100 + totalTime / 2) / totalTime), 100);
-            controlBar->setProgress(newProgress);
+            controlBar->setProgress(progressOf(currentTime));
         }
     }
 }
@@ -83,7 +82,7 @@ void VideoPlayerUi::setSpeed(float speed) {
 }
 
 void VideoPlayerUi::setProgress(int progress) {
-    progress = qBound(0, progress, 100);
+    progress = qBound(0, progress, ControlBar::PROGRESS_MAX);
     this->progress = progress;
     controlBar->setProgress(this->progress);
 }
@@ -187,26 +186,16 @@ void VideoPlayerUi::keyPressEvent(QKeyEvent* event) {
         if (!controlBar->getProgressSlider()->isEnabled()) {
             break;
         }
-        int64_t newTime = qMax(0LL, currentTime - 5);
-        int newProgress = 0;
-        if (totalTime > 0) {
-            newProgress = qBound(0, static_cast<int>((newTime * 100 + totalTime / 2) / totalTime), 100);
-        }
-        showTimePreview(newProgress);
-        emit seekRequest(newProgress);
+        showTimePreview(progressOf(currentTime - SEEK_STEP));
+        emit seekRelativeRequest(-SEEK_STEP);
         break;
     }
     case Qt::Key_Right: {
         if (!controlBar->getProgressSlider()->isEnabled()) {
             break;
         }
-        int64_t newTime = qMin(totalTime, currentTime + 5);
-        int newProgress = 0;
-        if (totalTime > 0) {
-            newProgress = qBound(0, static_cast<int>((newTime * 100 + totalTime / 2) / totalTime), 100);
-        }
-        showTimePreview(newProgress);
-        emit seekRequest(newProgress);
+        showTimePreview(progressOf(currentTime + SEEK_STEP));
+        emit seekRelativeRequest(SEEK_STEP);
         break;
     }
     case Qt::Key_M: {
@@ -236,6 +225,12 @@ void VideoPlayerUi::resizeEvent(QResizeEvent* event) {
     QWidget::resizeEvent(event);
     controlBar->resize(videoRenderer->width(), 120);
     controlBar->move(0, videoRenderer->height() - controlBar->height());
+    emit viewportResized(getViewportSize());
+}
+
+QSize VideoPlayerUi::getViewportSize() const {
+    const qreal ratio = videoRenderer->devicePixelRatioF();
+    return QSize(qRound(videoRenderer->width() * ratio), qRound(videoRenderer->height() * ratio));
 }
 
 void VideoPlayerUi::dragEnterEvent(QDragEnterEvent* event) {
@@ -249,14 +244,28 @@ void VideoPlayerUi::dragEnterEvent(QDragEnterEvent* event) {
     event->ignore();
 }
 
+// Several dropped files are played back to back as a playlist in drop order.
 void VideoPlayerUi::dropEvent(QDropEvent* event) {
-    const QList<QUrl> urls = event->mimeData()->urls();
-    if (!urls.isEmpty() && isValidVideoFile(urls.first().toLocalFile())) {
-        filePath = urls.first().toLocalFile();
-        networkUrl.clear();
+    QStringList files;
+    for (const QUrl& url : event->mimeData()->urls()) {
+        if (isValidVideoFile(url.toLocalFile())) {
+            files.append(url.toLocalFile());
+        }
+    }
+
+    if (files.isEmpty()) {
+        return;
+    }
+
+    filePath = files.first();
+    networkUrl.clear();
+    if (files.size() > 1) {
+        emit loadPlaylist(files);
+    }
+    else {
         emit loadLocalVideo(filePath);
-        event->acceptProposedAction();
     }
+    event->acceptProposedAction();
 }
 
 bool VideoPlayerUi::eventFilter(QObject* object, QEvent* event) {
@@ -346,14 +355,14 @@ void VideoPlayerUi::onFullscreenClicked() {
 void VideoPlayerUi::onProgressSliderMoved(int value) {
     progressMoved = true;
     setProgress(value);
-    showTimePreview(qBound(0, value, 100));
-    emit seekRequest(value);
+    showTimePreview(qBound(0, value, ControlBar::PROGRESS_MAX));
+    emit seekRequest(timeOf(value));
 }
 
 void VideoPlayerUi::onProgressSliderReleased(int value) {
     if (!progressMoved) {
         setProgress(value);
-        emit seekRequest(value);
+        emit seekRequest(timeOf(value));
     }
 
     progressMoved = false;
@@ -670,8 +679,7 @@ void VideoPlayerUi::showTimePreview(int progress) {
             return;
         }
 
-        int64_t previewTime = (static_cast<int64_t>(progress) * totalTime + 50) / 100;
-        QString timeText = QString("%1 / %2").arg(formatTime(previewTime), formatTime(totalTime));
+        QString timeText = QString("%1 / %2").arg(formatTime(timeOf(progress)), formatTime(totalTime));
         timePreviewLabel->setText(timeText);
         timePreviewLabel->adjustSize();
 
@@ -752,11 +760,23 @@ bool VideoPlayerUi::isValidVideoFile(const QString& filePath) const {
           (mimeType.name().contains("mp4") || mimeType.name().contains("mpeg")));
 }
 
-QString VideoPlayerUi::formatTime(int64_t seconds) const {
-    if (seconds < 0) {
-        seconds = 0;
+int VideoPlayerUi::progressOf(int64_t time) const {
+    if (totalTime <= 0) {
+        return 0;
     }
 
+    time = qBound(static_cast<int64_t>(0), time, totalTime);
+    return static_cast<int>((time * ControlBar::PROGRESS_MAX + totalTime / 2) / totalTime);
+}
+
+int64_t VideoPlayerUi::timeOf(int progress) const {
+    progress = qBound(0, progress, ControlBar::PROGRESS_MAX);
+    return (static_cast<int64_t>(progress) * totalTime + ControlBar::PROGRESS_MAX / 2) / ControlBar::PROGRESS_MAX;
+}
+
+QString VideoPlayerUi::formatTime(int64_t time) const {
+    int64_t seconds = time > 0 ? time / TIME_BASE : 0;
+
     int64_t hours = seconds / 3600;
     int64_t minutes = (seconds % 3600) / 60;
     int64_t secs = seconds % 60;
@@ -13,7 +13,40 @@
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+
+    // VideoPlayer --bench-volume prints the throughput of the volume kernels and exits.
+    if (app.arguments().contains("--bench-volume")) {
+        for (const media::GainBenchmark& result : media::AudioGain::benchmark()) {
+            qInfo("%-9s %8.1f Msamples/s", media::AudioGain::name(result.kernel), result.samplesPerSecond / 1e6);
+        }
+        return 0;
+    }
+
     VideoPlayer window;
     window.show();
+
+    // VideoPlayer [--loop] [--decode-threads=auto|frame|slice[:max]|<count>] file...
+    QStringList files = app.arguments().mid(1);
+    bool loop = files.removeAll("--loop") > 0;
+
+    for (int i = files.size() - 1; i >= 0; --i) {
+        if (!files[i].startsWith("--decode-threads=")) {
+            continue;
+        }
+
+        media::DecodeThreadPolicy policy;
+        QString value = files[i].mid(QString("--decode-threads=").size());
+        if (media::DecodeThreading::parse(value.toStdString(), policy)) {
+            window.setDecodeThreading(policy);
+        }
+        else {
+            qWarning("Invalid decode threads option: %s", qPrintable(value));
+        }
+        files.removeAt(i);
+    }
+    if (!files.isEmpty()) {
+        window.playPlaylist(files, loop);
+    }
+
     return app.exec();
 }
\ No newline at end of file